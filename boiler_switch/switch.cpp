@@ -7,6 +7,10 @@
 #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
 
+#include "../common/async_client.h"
+#include "../common/payload.h"
+#include "../common/report.h"
+#include "../common/wifi.h"
 
 #include "../config/gemconfig.h"
 
@@ -33,7 +37,11 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length);
 
 
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+
+// states are sent on change, and once a minute as a keep alive
+gemha::Report<uint8_t> reports[3] = { {0, 60000}, {0, 60000}, {0, 60000} };
 
 void setup() {
 	pinMode(Relay, OUTPUT_OPEN_DRAIN);
@@ -47,11 +55,7 @@ void setup() {
 
 	Serial.print("Connecting to ");
 	Serial.println(ssid);
-	WiFi.hostname(otaHostname);
-	WiFi.begin(ssid, passwd);
-
-	while (WiFi.status() != WL_CONNECTED) {
-		delay(500);
+	while (!gemha::joinWiFi(otaHostname)) {
 		Serial.print(".");
 	}
 	Serial.println("");
@@ -65,16 +69,25 @@ void setup() {
 	ArduinoOTA.setHostname(otaHostname);
 	ArduinoOTA.begin();
 
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
 }
 
+bool publishState(const char *topic, uint8_t value, gemha::Report<uint8_t> &report, bool force) {
+	if (!report.due(value, force))
+		return true;
+	if (!client.publish(topic, value ? "1" : "0"))
+		return false;
+	report.sent(value);
+	return true;
+}
+
 bool publish() {
+	bool force = false;
 	if (!client.connected()) {
-		String clientId = "Co2Client-";
-		clientId += String(random(0xffff), HEX);
-		if (client.connect(clientId.c_str())) {
-			client.subscribe(TOPIC_VALUE);
+		if (gemha::connectMqtt(client, otaHostname, TOPIC_VALUE)) {
+			gemha::reportBoot(client, otaHostname);
+			force = true;
 		} else {
 			Serial.print("mqtt connect failed, rc=");
 			Serial.println(client.state());
@@ -83,9 +96,9 @@ bool publish() {
 	}
 	bool ret = true;
 
-	ret &= client.publish(TOPIC_VALUE, digitalRead(Relay) ? "0" : "1");
-	ret &= client.publish(TOPIC_INPUT "0", digitalRead(Input0) ? "1" : "0");
-	ret &= client.publish(TOPIC_INPUT "1", digitalRead(Input1) ? "1" : "0");
+	ret &= publishState(TOPIC_VALUE, !digitalRead(Relay), reports[0], force);
+	ret &= publishState(TOPIC_INPUT "0", digitalRead(Input0), reports[1], force);
+	ret &= publishState(TOPIC_INPUT "1", digitalRead(Input1), reports[2], force);
 
 	return ret;
 }
@@ -94,35 +107,24 @@ long lastRead;
 void loop() {
 	client.loop();
 	ArduinoOTA.handle();
+	gemha::keepLease();
 
 	long now = millis();
 	if (now - lastRead > PERIOD) {
 		lastRead = now;
 
 #ifdef DEBUG
-		Serial.printf("Relay: %d, Input0: %d, Input1: %d\r\n",
+		Serial.printf("Relay: %d, Input0: %d, Input1: %d, suppressed: %u\r\n",
 				digitalRead(Relay),
 				digitalRead(Input0),
-				digitalRead(Input1));
+				digitalRead(Input1),
+				reports[0].suppressedCount() + reports[1].suppressedCount()
+						+ reports[2].suppressedCount());
 #endif
 		publish();
 	}
 }
 
-int getValue(const byte *payload, unsigned int length) {
-	char buf[8];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return -1;
-
-	memcpy(buf, payload, length);
-	char *dummy;
-	int value = strtoul(buf, &dummy, 10);
-	if (dummy == buf)
-		return -1;
-	return value;
-}
-
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 #ifdef DEBUG
 	Serial.print("Message arrived [");
@@ -137,10 +139,10 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	if (strncmp(topic, TOPIC_VALUE, sizeof(TOPIC_VALUE) - 1) != 0)
 		return;
 
-	int value = getValue(payload, length);
-	if (value != 0 && value != 1)
+	bool on;
+	if (gemha::parseBool(payload, length, on) != gemha::PARSE_OK)
 		return;
-	value = !value;
+	int value = !on;
 	Serial.print("Set value to ");
 	Serial.println(value);
 
@@ -13,6 +13,13 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 
+#include "../common/async_client.h"
+#include "../common/batch.h"
+#include "../common/co2.h"
+#include "../common/outbox.h"
+#include "../common/report.h"
+#include "../common/wifi.h"
+
 #include "../config/gemconfig.h"
 
 const char *otaHostname = "co2.gem";
@@ -26,6 +33,15 @@ const char *topicHumidity = TOPIC"/humidity";
 const char *topicBrightness = TOPIC"/brightness";
 const char *topicBroadcast = "house/broadcast";
 
+// TOPIC/co2, /temperature and /humidity, or all three as one JSON object on
+// TOPIC, or both
+const gemha::PublishMode PUBLISH_MODE = gemha::PER_VALUE;
+// TEXT, or CBOR to skip float formatting and shrink the payloads
+const gemha::Encoding ENCODING = gemha::TEXT;
+
+gemha::Report<int> co2Report(20);
+gemha::Report<float> temperatureReport(0.2), humidityReport(1.0);
+
 const int RX = D5;
 const int TX = D6;
 
@@ -89,7 +105,10 @@ SoftwareSerial co2Serial(RX, TX);
 Adafruit_HTU21DF htu;
 
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+// readings taken while offline, every PERIOD
+gemha::Outbox<> outbox;
 
 Adafruit_SSD1306 display(128, 32);
 
@@ -117,10 +136,7 @@ void setup() {
 
 	Serial.print("Connecting to ");
 	Serial.println(ssid);
-	WiFi.begin(ssid, passwd);
-
-	while (WiFi.status() != WL_CONNECTED) {
-		delay(500);
+	while (!gemha::joinWiFi(otaHostname)) {
 		display.print(".");
 		display.display();
 		Serial.print(".");
@@ -146,38 +162,83 @@ void setup() {
 	ArduinoOTA.begin();
 
 	co2Serial.begin(9600);
+	outbox.begin();
 
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
 	readCO2(); // ignore first read
 
 	htu.begin();
 }
 
+// a report counts as sent once every enabled way of publishing it went out
+template<typename T>
+bool publishValue(const char *topic, T value, uint8_t decimals,
+		gemha::Report<T> &report, bool batched) {
+	if (PUBLISH_MODE & gemha::PER_VALUE) {
+		uint8_t msg[gemha::VALUE_MAX];
+		uint8_t len = gemha::encodeValue(msg, value, decimals, ENCODING);
+		if (!client.publish(topic, msg, len))
+			return false;
+	}
+	if (batched)
+		report.sent(value);
+	return true;
+}
+
+// the outbox keeps text, drained records are wrapped in JSON
+template<typename T>
+void queueValue(const char *topic, const char *format, T value) {
+	char msg[16];
+	snprintf(msg, sizeof(msg), format, value);
+	outbox.push(topic, msg);
+}
+
 bool publish(int co2, float t, float h) {
+	bool force = false;
 	if (!client.connected()) {
-		String clientId = "Co2Client-";
-		clientId += String(random(0xffff), HEX);
-		if (client.connect(clientId.c_str())) {
-			client.subscribe(topicBroadcast);
+		if (gemha::connectMqtt(client, otaHostname, topicBroadcast)) {
+			gemha::reportBoot(client, otaHostname);
+			force = true;
 		} else {
 			Serial.print("mqtt connect failed, rc=");
 			Serial.println(client.state());
+			if (co2 > 0)
+				queueValue(topicCo2, "%d", co2);
+			if (t != 0 && h != 0) {
+				queueValue(topicTemperatue, "%.2f", t);
+				queueValue(topicHumidity, "%.2f", h);
+			}
 			return false;
 		}
 	}
-	bool ret = true;
-	char msg[16];
-	if (co2 > 0) {
-		snprintf(msg, sizeof(msg), "%d", co2);
-		ret &= client.publish(topicCo2, msg);
-	}
-	if (t != 0 && h != 0) {
-		snprintf(msg, sizeof(msg), "%.2f", t);
-		ret &= client.publish(topicTemperatue, msg);
-		snprintf(msg, sizeof(msg), "%.2f", h);
-		ret &= client.publish(topicHumidity, msg);
+	outbox.drain(client);
+	bool th = t != 0 && h != 0;
+	bool co2Due = co2 > 0 && co2Report.due(co2, force);
+	bool tDue = th && temperatureReport.due(t, force);
+	bool hDue = th && humidityReport.due(h, force);
+	if (!co2Due && !tDue && !hDue)
+		return true;
+
+	// the batch carries all readings and goes out when any of them is due
+	bool batched = true;
+	if (PUBLISH_MODE & gemha::BATCHED) {
+		batched = gemha::publishBatch(client, TOPIC, [&](gemha::Batch &batch) {
+			if (co2 > 0)
+				batch.add("co2", co2);
+			if (th) {
+				batch.add("temperature", t, 2);
+				batch.add("humidity", h, 2);
+			}
+		}, ENCODING);
 	}
+	bool ret = batched;
+	if (co2Due)
+		ret &= publishValue(topicCo2, co2, 0, co2Report, batched);
+	if (tDue)
+		ret &= publishValue(topicTemperatue, t, 2, temperatureReport, batched);
+	if (hDue)
+		ret &= publishValue(topicHumidity, h, 2, humidityReport, batched);
 
 	return ret;
 }
@@ -186,6 +247,7 @@ long lastRead;
 void loop() {
 	client.loop();
 	ArduinoOTA.handle();
+	gemha::keepLease();
 
 	publish(-1, 0, 0);
 
@@ -197,8 +259,11 @@ void loop() {
 		state.h = htu.readHumidity();
 
 #ifdef DEBUG
-		Serial.printf("CO2: %d, T: %.2f, H: %.2f\r\n", state.co2, state.t,
-				state.h);
+		Serial.printf("CO2: %d, T: %.2f, H: %.2f, suppressed: %u, queued: %u, dropped: %u\r\n", state.co2,
+				state.t, state.h,
+				co2Report.suppressedCount() + temperatureReport.suppressedCount()
+						+ humidityReport.suppressedCount(),
+				outbox.queuedCount(), outbox.droppedCount());
 #endif
 		bool connected = publish(state.co2, state.t, state.h);
 		if (!connected) {
@@ -223,39 +288,26 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 }
 
 int readCO2() {
-	byte cmd[9] = { 0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79 };
-// command to ask for data
-	byte response[9]; // for answer
+	byte response[gemha::CO2_FRAME]; // for answer
 
-	co2Serial.write(cmd, 9); //request PPM CO2
+	co2Serial.write(gemha::co2Request, sizeof(gemha::co2Request)); //request PPM CO2
 
 // The serial stream can get out of sync. The response starts with 0xff, try to resync.
 	while (co2Serial.available() > 0 && (unsigned char) co2Serial.peek() != 0xFF) {
 		co2Serial.read();
 	}
 
-	memset(response, 0, 9);
-	co2Serial.readBytes(response, 9);
+	memset(response, 0, sizeof(response));
+	co2Serial.readBytes(response, sizeof(response));
 
-	if (response[1] != 0x86) {
+	int ppm = gemha::parseCO2(response);
+	if (ppm == gemha::CO2_INVALID) {
 		Serial.println("Invalid response from co2 sensor!");
 		return -1;
 	}
-
-	byte crc = 0;
-	for (int i = 1; i < 8; i++) {
-		crc += response[i];
-	}
-	crc = 255 - crc + 1;
-
-	if (response[8] == crc) {
-		int responseHigh = (int) response[2];
-		int responseLow = (int) response[3];
-		int ppm = (256 * responseHigh) + responseLow;
-		return ppm;
-	} else {
+	if (ppm == gemha::CO2_CRC_ERROR) {
 		Serial.println("CRC error!");
 		return -1;
 	}
+	return ppm;
 }
-
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "Arduino.h"
+#include "Client.h"
+
+#ifdef ARDUINO
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#else
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include <errno.h>
+#endif
+#endif
+
+#include <algorithm>
+
+namespace gemha {
+
+#ifdef ARDUINO
+#ifdef ESP8266
+// lwIP copies up to availableForWrite() without waiting for an ack
+inline int sendNow(WiFiClient &net, const uint8_t *buf, size_t size) {
+	if (!net.connected())
+		return -1;
+	size_t room = net.availableForWrite();
+	if (room == 0)
+		return 0;
+	return net.write(buf, std::min(size, room));
+}
+#else
+inline int sendNow(WiFiClient &net, const uint8_t *buf, size_t size) {
+	int fd = net.fd();
+	if (fd < 0)
+		return -1;
+	int sent = send(fd, buf, size, MSG_DONTWAIT);
+	if (sent >= 0)
+		return sent;
+	return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+}
+
+// the core waits up to 3 s by default
+inline int connectNow(WiFiClient &net, IPAddress ip, uint16_t port, int32_t ms) {
+	return net.connect(ip, port, ms);
+}
+
+inline int connectNow(WiFiClient &net, const char *host, uint16_t port, int32_t ms) {
+	return net.connect(host, port, ms);
+}
+#endif
+#endif
+
+// Net's own connect timeout applies, the ESP8266 core gives up after 1 s
+template<typename Net, typename Host>
+int connectNow(Net &net, Host host, uint16_t port, int32_t) {
+	return net.connect(host, port);
+}
+
+// The transport under PubSubClient: PubSubClient client(net), net an
+// AsyncClient around the WiFiClient. Writes never wait for the socket,
+// MQTT packets are queued in SIZE bytes and go out as the TCP send buffer
+// takes them, from every later call (loop(), publish()...). A packet is
+// queued whole or refused whole: with the queue full publish() returns
+// false at once instead of blocking for the socket timeout, and the
+// stream never gets half a packet. A connection that takes nothing for
+// STALL_MS while data is queued is closed, PubSubClient then sees it lost.
+// A TCP connect waits at most CONNECT_MS.
+//
+// Net needs sendNow(Net&, const uint8_t*, size_t): the bytes the socket
+// took without blocking, 0 if none, -1 when the connection is broken.
+template<typename Net, uint16_t SIZE = 2048>
+class BasicAsyncClient : public Client {
+public:
+	static const unsigned long STALL_MS = 10000;
+	static const int32_t CONNECT_MS = 1000;
+
+	BasicAsyncClient(Net &net) : net(net) {
+	}
+
+#ifdef ARDUINO
+	int connect(IPAddress ip, uint16_t port) {
+		reset();
+		return connectNow(net, ip, port, CONNECT_MS);
+	}
+#endif
+
+	int connect(const char *host, uint16_t port) {
+		reset();
+		return connectNow(net, host, port, CONNECT_MS);
+	}
+
+	size_t write(uint8_t c) {
+		return write(&c, 1);
+	}
+
+	size_t write(const uint8_t *buf, size_t size) {
+		if (broken)
+			return 0;
+		size_t done = 0;
+		while (done < size) {
+			if (packetLeft == 0) {
+				// a packet starts, its fixed header tells the whole length
+				uint32_t total;
+				if (!packetLength(buf + done, size - done, total) || total > SIZE - count) {
+					refused++;
+					pump();
+					return done;
+				}
+				packetLeft = total;
+			}
+			size_t n = std::min<size_t>(size - done, packetLeft);
+			push(buf + done, n);
+			packetLeft -= n;
+			done += n;
+		}
+		pump();
+		return done;
+	}
+
+	int available() {
+		pump();
+		return net.available();
+	}
+
+	int read() {
+		return net.read();
+	}
+
+	int read(uint8_t *buf, size_t size) {
+		return net.read(buf, size);
+	}
+
+	int peek() {
+		return net.peek();
+	}
+
+	// doesn't wait, what the socket won't take stays queued
+	void flush() {
+		pump();
+	}
+
+	void stop() {
+		pump();
+		net.stop();
+		reset();
+	}
+
+	uint8_t connected() {
+		pump();
+		return !broken && net.connected();
+	}
+
+	operator bool() {
+		return connected();
+	}
+
+	using Print::write;
+
+	// bytes waiting for the socket
+	size_t queued() const {
+		return count;
+	}
+
+	// the queue is over half full: a good time to skip what can wait
+	bool congested() const {
+		return count > SIZE / 2;
+	}
+
+	// packets refused for want of room
+	uint32_t refusedCount() const {
+		return refused;
+	}
+
+	// connections closed for making no progress
+	uint32_t stallCount() const {
+		return stalls;
+	}
+private:
+	// type byte and remaining length, 1 to 4 bytes of 7 bits
+	static bool packetLength(const uint8_t *buf, size_t size, uint32_t &total) {
+		uint32_t length = 0;
+		for (size_t i = 1; i < size && i <= 4; i++) {
+			length |= uint32_t(buf[i] & 0x7f) << (7 * (i - 1));
+			if (!(buf[i] & 0x80)) {
+				total = 1 + i + length;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void push(const uint8_t *buf, size_t n) {
+		if (count == 0)
+			progressAt = millis();
+		size_t head = (tail + count) % SIZE;
+		size_t first = std::min<size_t>(n, SIZE - head);
+		memcpy(ring + head, buf, first);
+		memcpy(ring, buf + first, n - first);
+		count += n;
+	}
+
+	void pump() {
+		while (count > 0 && !broken) {
+			int sent = sendNow(net, ring + tail, std::min<size_t>(count, SIZE - tail));
+			if (sent < 0) {
+				fail();
+				return;
+			}
+			if (sent == 0) {
+				if (millis() - progressAt > STALL_MS) {
+					stalls++;
+					fail();
+				}
+				return;
+			}
+			tail = (tail + sent) % SIZE;
+			count -= sent;
+			progressAt = millis();
+		}
+	}
+
+	void fail() {
+		broken = true;
+		net.stop();
+		count = 0;
+	}
+
+	void reset() {
+		tail = 0;
+		count = 0;
+		packetLeft = 0;
+		broken = false;
+	}
+
+	Net &net;
+	uint8_t ring[SIZE];
+	size_t tail = 0;
+	size_t count = 0;
+	uint32_t packetLeft = 0;
+	bool broken = false;
+	unsigned long progressAt = 0;
+	uint32_t refused = 0;
+	uint32_t stalls = 0;
+};
+
+#ifdef ARDUINO
+typedef BasicAsyncClient<WiFiClient> AsyncClient;
+#endif
+
+} // namespace gemha
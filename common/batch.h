@@ -0,0 +1,203 @@
+#pragma once
+
+#include "Arduino.h"
+#include "cbor.h"
+
+#include <PubSubClient.h>
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace gemha {
+
+// What a sketch publishes: a topic per value, one batch per device, or both
+enum PublishMode {
+	PER_VALUE = 1,
+	BATCHED = 2,
+	BOTH = PER_VALUE | BATCHED
+};
+
+// A device's readings as one object keyed by name, compact JSON,
+// {"voltage":230.100,...}, or a CBOR map, streamed into the publish through
+// a small buffer. Without an output it only counts the bytes.
+class Batch {
+public:
+	Batch(Encoding encoding = TEXT, Print *out = nullptr, size_t limit = 0) :
+			encoding(encoding), out(out), limit(limit) {
+	}
+
+	void add(const char *key, int value) {
+		add(key, long(value));
+	}
+
+	void add(const char *key, long value) {
+		field(key);
+		number(value);
+	}
+
+	// NaN, e.g. a failed read, is left out. decimals only apply to text.
+	void add(const char *key, float value, uint8_t decimals) {
+		if (isnan(value))
+			return;
+		field(key);
+		number(value, decimals);
+	}
+
+	// one value per channel, a failed read is null
+	void add(const char *key, const float *values, uint8_t count, uint8_t decimals) {
+		field(key);
+		if (encoding == CBOR) {
+			uint8_t buf[cbor::ITEM_MAX];
+			append(buf, cbor::head(buf, cbor::ARRAY, count));
+		} else
+			put('[');
+		for (auto i = 0; i < count; i++) {
+			if (encoding == TEXT && i > 0)
+				put(',');
+			if (!isnan(values[i]))
+				number(values[i], decimals);
+			else if (encoding == CBOR)
+				put(cbor::NIL);
+			else
+				append("null");
+		}
+		if (encoding == TEXT)
+			put(']');
+	}
+
+	// Closes the object and returns its length. Output stops at the limit
+	// and a shorter object is padded, with spaces or CBOR nulls, the
+	// publish always gets the announced length.
+	size_t finish() {
+		if (encoding == CBOR) {
+			put(count > 0 ? cbor::BREAK : cbor::MAP);
+		} else {
+			if (count == 0)
+				put('{');
+			put('}');
+		}
+		size_t ret = length;
+		while (out != nullptr && length < limit)
+			put(encoding == CBOR ? cbor::NIL : ' ');
+		flush();
+		return ret;
+	}
+private:
+	void field(const char *key) {
+		if (encoding == CBOR) {
+			if (count++ == 0)
+				put(cbor::MAP_START);
+			uint8_t buf[cbor::ITEM_MAX];
+			append(buf, cbor::head(buf, cbor::TEXT_STRING, strlen(key)));
+			append(key);
+			return;
+		}
+		put(count++ ? ',' : '{');
+		put('"');
+		append(key);
+		put('"');
+		put(':');
+	}
+
+	void number(long value) {
+		if (encoding == CBOR) {
+			uint8_t buf[cbor::ITEM_MAX];
+			append(buf, cbor::encodeInt(buf, value));
+			return;
+		}
+		char buf[12];
+		snprintf(buf, sizeof(buf), "%ld", value);
+		append(buf);
+	}
+
+	void number(float value, uint8_t decimals) {
+		if (encoding == CBOR) {
+			uint8_t buf[cbor::ITEM_MAX];
+			append(buf, cbor::encodeFloat(buf, value));
+			return;
+		}
+		char buf[24];
+		snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+		append(buf);
+	}
+
+	void append(const uint8_t *s, uint8_t n) {
+		for (auto i = 0; i < n; i++)
+			put(s[i]);
+	}
+
+	void append(const char *s) {
+		while (*s)
+			put(*s++);
+	}
+
+	void put(uint8_t c) {
+		if (out != nullptr && length < limit) {
+			buf[used++] = c;
+			if (used == sizeof(buf))
+				flush();
+		}
+		length++;
+	}
+
+	void flush() {
+		if (used > 0)
+			out->write(buf, used);
+		used = 0;
+	}
+
+	Encoding encoding;
+	Print *out;
+	size_t limit;
+	size_t length = 0;
+	uint8_t count = 0;
+	uint8_t used = 0;
+	uint8_t buf[64];
+};
+
+// PubSubClient wants the length before the payload, so fill(Batch&) runs
+// twice, once counting and once writing. It must add the same values both
+// times: read the sensors before, not in it.
+template<typename F>
+bool publishBatch(PubSubClient &client, const char *topic, F fill,
+		Encoding encoding = TEXT, bool retained = false) {
+	Batch counter(encoding);
+	fill(counter);
+	size_t length = counter.finish();
+	if (!client.beginPublish(topic, length, retained))
+		return false;
+	Batch batch(encoding, &client, length);
+	fill(batch);
+	bool ok = batch.finish() == length;
+	return client.endPublish() == 1 && ok;
+}
+
+static const uint8_t VALUE_MAX = 24;
+
+// snprintf's result as the bytes it wrote: a value too long for VALUE_MAX
+// comes out truncated, not with its would-be length
+inline uint8_t valueLength(int n) {
+	return n < 0 ? 0 : std::min(n, VALUE_MAX - 1);
+}
+
+// One reading as a payload of its own, text or CBOR, into VALUE_MAX bytes.
+// Returns the length. decimals only apply to a float as text.
+
+inline uint8_t encodeValue(uint8_t *buf, float value, uint8_t decimals, Encoding encoding) {
+	if (encoding == CBOR)
+		return cbor::encodeFloat(buf, value);
+	return valueLength(snprintf((char*) buf, VALUE_MAX, "%.*f", decimals, value));
+}
+
+inline uint8_t encodeValue(uint8_t *buf, long value, uint8_t decimals, Encoding encoding) {
+	if (encoding == CBOR)
+		return cbor::encodeInt(buf, value);
+	return valueLength(snprintf((char*) buf, VALUE_MAX, "%ld", value));
+}
+
+inline uint8_t encodeValue(uint8_t *buf, int value, uint8_t decimals, Encoding encoding) {
+	return encodeValue(buf, long(value), decimals, encoding);
+}
+
+} // namespace gemha
@@ -1,15 +1,27 @@
 #pragma once
 
 #include "Arduino.h"
+#include "esp_timer.h"
+#include "soc/gpio_reg.h"
+
+#include <initializer_list>
 
 namespace gemha {
 
+// Input change passed from the input task to the publisher.
+struct InputEvent {
+	uint8_t input;
+	bool value;
+	int64_t timestamp;
+};
+
 class Button {
 public:
 	Button(uint8_t pin, bool pullup = true, bool inverse = false) : pin(pin), inverse(inverse) {
 		pinMode(pin, pullup ? INPUT_PULLUP : INPUT);
 	}
 
+	// Polled mode, call every few ms.
 	void check() {
 		bool v = digitalRead(pin);
 		if (v == val) {
@@ -19,20 +31,157 @@ public:
 		counter++;
 		if (counter >= delay) {
 			val = v;
+			changedAt = esp_timer_get_time();
+		}
+	}
+
+	// Interrupt mode: every edge restarts a one-shot timer, the new level is
+	// accepted once the pin stayed quiet for settleMs. The task, if given,
+	// is notified on every accepted change.
+	bool attach(TaskHandle_t task = nullptr, uint32_t settleMs = 10) {
+		if (timer == nullptr) {
+			esp_timer_create_args_t args = { };
+			args.callback = onTimer;
+			args.arg = this;
+			args.name = "button";
+			if (esp_timer_create(&args, &timer) != ESP_OK)
+				return false;
 		}
+		notify = task;
+		settle = settleMs * 1000;
+		val = digitalRead(pin);
+		attachInterruptArg(pin, onEdge, this, CHANGE);
+		return true;
 	}
+
+	void detach() {
+		detachInterrupt(pin);
+		if (timer != nullptr) {
+			esp_timer_stop(timer);
+			esp_timer_delete(timer);
+			timer = nullptr;
+		}
+		settling = false;
+	}
+
 	operator bool() const {
 		return value();
 	}
 	bool value() const {
 		return inverse ? !val :val;
 	}
+	// esp_timer_get_time() of the edge which caused the last change
+	int64_t lastChange() const {
+		return changedAt;
+	}
 private:
+	static void IRAM_ATTR onEdge(void *arg) {
+		auto b = static_cast<Button*>(arg);
+		// the first edge of a bounce is the one that counts
+		if (!b->settling) {
+			b->edgeAt = esp_timer_get_time();
+			b->settling = true;
+		}
+		esp_timer_stop(b->timer);
+		esp_timer_start_once(b->timer, b->settle);
+	}
+
+	static void onTimer(void *arg) {
+		auto b = static_cast<Button*>(arg);
+		b->settling = false;
+		bool v = digitalRead(b->pin);
+		if (v == b->val)
+			return;
+		b->val = v;
+		b->changedAt = b->edgeAt;
+		if (b->notify != nullptr)
+			xTaskNotifyGive(b->notify);
+	}
+
 	const uint8_t pin;
 	const bool inverse;
-	bool val = false; // TODO volatile ?
+	volatile bool val = false;
 	uint8_t counter = 0;
 	const static uint8_t delay = 5;
+
+	esp_timer_handle_t timer = nullptr;
+	TaskHandle_t notify = nullptr;
+	uint32_t settle = 0;
+	volatile bool settling = false;
+	volatile int64_t edgeAt = 0;
+	volatile int64_t changedAt = 0;
+};
+
+// Debounces up to 40 GPIO inputs at once. check() reads both GPIO input
+// registers and runs a 2 bit vertical counter per pin, so a level has to
+// be stable for 4 ticks to be accepted. Cost does not depend on the number
+// of inputs. Inputs are indexed in declaration order like a Button array.
+template<uint8_t N>
+class ButtonBank {
+public:
+	struct Input {
+		Input(uint8_t pin, bool pullup = true, bool inverse = false) :
+				pin(pin), pullup(pullup), inverse(inverse) {
+		}
+		uint8_t pin;
+		bool pullup;
+		bool inverse;
+	};
+
+	ButtonBank(std::initializer_list<Input> list) {
+		uint8_t n = 0;
+		for (auto &i : list) {
+			if (n == N)
+				break;
+			pinMode(i.pin, i.pullup ? INPUT_PULLUP : INPUT);
+			pins[n++] = i.pin;
+			mask |= bit(i.pin);
+			if (i.inverse)
+				inverse |= bit(i.pin);
+		}
+		state = read() & mask;
+	}
+
+	// Samples all inputs, returns a mask (bit per GPIO) of accepted changes.
+	uint64_t check() {
+		uint64_t delta = (read() ^ state) & mask;
+		ct0 = ~(ct0 & delta);
+		ct1 = ct0 ^ (ct1 & delta);
+		uint64_t changed = delta & ct0 & ct1;
+		state ^= changed;
+		return changed;
+	}
+
+	bool operator[](uint8_t i) const {
+		return pinValue(pins[i]);
+	}
+	uint8_t pin(uint8_t i) const {
+		return pins[i];
+	}
+	uint8_t size() const {
+		return N;
+	}
+	bool pinValue(uint8_t pin) const {
+		return (values() >> pin) & 1;
+	}
+	// debounced snapshot of all inputs, bit per GPIO
+	uint64_t values() const {
+		return state ^ inverse;
+	}
+
+	static uint64_t bit(uint8_t pin) {
+		return uint64_t(1) << pin;
+	}
+	static uint64_t read() {
+		return REG_READ(GPIO_IN_REG) | uint64_t(REG_READ(GPIO_IN1_REG) & 0xff) << 32;
+	}
+private:
+	uint8_t pins[N];
+	uint64_t mask = 0;
+	uint64_t inverse = 0;
+	uint64_t state = 0;
+	uint64_t ct0 = ~uint64_t(0);
+	uint64_t ct1 = ~uint64_t(0);
 };
 
 } // namespace gemha
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <string.h>
+
+namespace gemha {
+
+// How readings go on the wire: text, "21.5" per value and JSON for a
+// batch, or CBOR (RFC 8949). CBOR takes no float formatting, a float is
+// copied bit for bit: 3 bytes when half precision holds it exactly, 5
+// otherwise. host/tools/cbor2json turns it back into JSON.
+enum Encoding {
+	TEXT,
+	CBOR
+};
+
+namespace cbor {
+
+static const uint8_t UNSIGNED = 0x00;
+static const uint8_t NEGATIVE = 0x20;
+static const uint8_t TEXT_STRING = 0x60;
+static const uint8_t ARRAY = 0x80;
+static const uint8_t MAP = 0xa0;
+static const uint8_t MAP_START = 0xbf; // indefinite length
+static const uint8_t NIL = 0xf6;
+static const uint8_t HALF = 0xf9;
+static const uint8_t SINGLE = 0xfa;
+static const uint8_t BREAK = 0xff;
+
+// longest item written here
+static const uint8_t ITEM_MAX = 9;
+
+// major type and its argument, 1 to 9 bytes
+inline uint8_t head(uint8_t *buf, uint8_t major, uint64_t v) {
+	if (v < 24) {
+		buf[0] = major | v;
+		return 1;
+	}
+	uint8_t n = v <= 0xff ? 1 : v <= 0xffff ? 2 : v <= 0xffffffff ? 4 : 8;
+	buf[0] = major | (n == 1 ? 24 : n == 2 ? 25 : n == 4 ? 26 : 27);
+	for (auto i = n; i > 0; i--, v >>= 8)
+		buf[i] = v;
+	return n + 1;
+}
+
+inline uint8_t encodeInt(uint8_t *buf, long v) {
+	if (v < 0)
+		return head(buf, NEGATIVE, uint64_t(-1 - v));
+	return head(buf, UNSIGNED, v);
+}
+
+// The half precision bits of a single, when it converts without loss.
+// DS18B20 readings, multiples of 1/16 °C, always do.
+inline bool toHalf(uint32_t f, uint16_t &h) {
+	uint16_t sign = (f >> 16) & 0x8000;
+	int exp = (f >> 23) & 0xff;
+	uint32_t mant = f & 0x7fffff;
+	if (exp == 0xff) {
+		h = sign | 0x7c00 | (mant != 0 ? 0x200 : 0);
+		return true;
+	}
+	if (exp == 0) {
+		h = sign;
+		return mant == 0;
+	}
+	int e = exp - 127 + 15;
+	if (e >= 31)
+		return false;
+	if (e >= 1) {
+		h = sign | e << 10 | mant >> 13;
+		return (mant & 0x1fff) == 0;
+	}
+	// subnormal half, 2^-24 steps
+	int shift = 126 - exp;
+	if (shift > 24)
+		return false;
+	mant |= 0x800000;
+	h = sign | mant >> shift;
+	return (mant & ((1ul << shift) - 1)) == 0;
+}
+
+inline uint8_t encodeFloat(uint8_t *buf, float v) {
+	uint32_t f;
+	memcpy(&f, &v, sizeof(f));
+	uint16_t h;
+	if (toHalf(f, h)) {
+		buf[0] = HALF;
+		buf[1] = h >> 8;
+		buf[2] = h;
+		return 3;
+	}
+	buf[0] = SINGLE;
+	for (auto i = 4; i > 0; i--, f >>= 8)
+		buf[i] = f;
+	return 5;
+}
+
+} // namespace cbor
+
+} // namespace gemha
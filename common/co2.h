@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Arduino.h"
+
+namespace gemha {
+
+// MH-Z19 "read CO2 concentration" command and response frame
+static const uint8_t CO2_FRAME = 9;
+static const byte co2Request[CO2_FRAME] = { 0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79 };
+
+static const int CO2_INVALID = -1;
+static const int CO2_CRC_ERROR = -2;
+
+inline int parseCO2(const byte *response) {
+	if (response[1] != 0x86)
+		return CO2_INVALID;
+
+	byte crc = 0;
+	for (int i = 1; i < 8; i++) {
+		crc += response[i];
+	}
+	crc = 255 - crc + 1;
+
+	if (response[8] != crc)
+		return CO2_CRC_ERROR;
+
+	int responseHigh = (int) response[2];
+	int responseLow = (int) response[3];
+	return (256 * responseHigh) + responseLow;
+}
+
+} // namespace gemha
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <OneWire.h>
+
+#include <driver/rmt.h>
+#include <freertos/ringbuf.h>
+#include <soc/gpio_periph.h>
+#include <soc/gpio_struct.h>
+#include <soc/io_mux_reg.h>
+
+namespace gemha {
+
+// 1-Wire master on the ESP32 RMT peripheral, the same interface as OneWire
+// for BasicTemperature<N, RmtOneWire>. The TX channel drives the time slots
+// on the open drain pin, the RX channel samples them on the same pin, and
+// the calling task sleeps on the RX ring buffer meanwhile: no interrupts
+// are disabled and no CPU time goes into busy waits. A byte is one RMT
+// transfer, a search takes two per ROM bit.
+// Every bus needs two of the eight channels. There is no strong pull-up,
+// parasite powered sensors need the external pull-up to suffice.
+class RmtOneWire {
+public:
+	RmtOneWire(uint8_t pin, rmt_channel_t tx = RMT_CHANNEL_0, rmt_channel_t rx = RMT_CHANNEL_1) :
+			pin(pin), tx(tx), rx(rx) {
+	}
+
+	// 1 when a device answered with a presence pulse
+	uint8_t reset() {
+		if (!begin())
+			return 0;
+		rmt_item32_t item;
+		item.level0 = 0;
+		item.duration0 = RESET_LOW;
+		item.level1 = 1;
+		item.duration1 = RESET_HIGH;
+
+		rmt_set_rx_idle_thresh(rx, RESET_LOW + 60);
+		size_t n;
+		rmt_item32_t *got = transfer(&item, 1, n);
+		// our reset pulse, then the presence pulse of the devices
+		bool presence = got != nullptr && n >= 2 && got[0].level0 == 0
+				&& got[0].duration0 >= RESET_LOW - 2 && got[1].level0 == 0;
+		release(got);
+		rmt_set_rx_idle_thresh(rx, RX_IDLE);
+		return presence;
+	}
+
+	void select(const uint8_t rom[8]) {
+		write(MATCH_ROM);
+		for (auto i = 0; i < 8; i++)
+			write(rom[i]);
+	}
+
+	void skip() {
+		write(SKIP_ROM);
+	}
+
+	void write(uint8_t v, uint8_t power = 0) {
+		slots(v, 8);
+	}
+
+	void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0) {
+		for (auto i = 0; i < count; i++)
+			write(buf[i]);
+	}
+
+	uint8_t read() {
+		return slots(0xff, 8);
+	}
+
+	void read_bytes(uint8_t *buf, uint16_t count) {
+		for (auto i = 0; i < count; i++)
+			buf[i] = read();
+	}
+
+	void write_bit(uint8_t v) {
+		slots(v & 1, 1);
+	}
+
+	uint8_t read_bit() {
+		return slots(1, 1);
+	}
+
+	void depower() {
+	}
+
+	void reset_search() {
+		lastDiscrepancy = 0;
+		lastDeviceFlag = false;
+		std::fill(romNo, romNo + 8, 0);
+	}
+
+	// search_mode false finds only the devices in alarm
+	bool search(uint8_t *newAddr, bool search_mode = true) {
+		if (lastDeviceFlag || !reset()) {
+			reset_search();
+			return false;
+		}
+		write(search_mode ? SEARCH_ROM : ALARM_SEARCH);
+
+		uint8_t discrepancy = 0;
+		for (uint8_t bit = 1; bit <= 64; bit++) {
+			uint8_t &byte = romNo[(bit - 1) / 8];
+			uint8_t mask = 1 << ((bit - 1) % 8);
+			// the bit and its complement, both in one transfer
+			uint8_t pair = slots(3, 2);
+			if (pair == 3) {
+				reset_search();
+				return false;
+			}
+			bool dir;
+			if (pair != 0)
+				dir = pair & 1;
+			else if (bit < lastDiscrepancy)
+				dir = byte & mask;
+			else
+				dir = bit == lastDiscrepancy;
+			if (pair == 0 && !dir)
+				discrepancy = bit;
+			if (dir)
+				byte |= mask;
+			else
+				byte &= ~mask;
+			write_bit(dir);
+		}
+		lastDiscrepancy = discrepancy;
+		lastDeviceFlag = discrepancy == 0;
+		std::copy(romNo, romNo + 8, newAddr);
+		return true;
+	}
+
+	static uint8_t crc8(const uint8_t *addr, uint8_t len) {
+		return OneWire::crc8(addr, len);
+	}
+private:
+	// Channels are set up on first use, not from a global constructor.
+	// RX is routed first: routing TX makes the pin an output and the input
+	// is enabled again by hand, then the pad is made open drain.
+	bool begin() {
+		if (ready)
+			return true;
+		rmt_config_t rxConfig = RMT_DEFAULT_CONFIG_RX((gpio_num_t) pin, rx);
+		rxConfig.clk_div = 80; // 1 µs ticks
+		rxConfig.rx_config.filter_en = true;
+		rxConfig.rx_config.filter_ticks_thresh = 30; // APB cycles
+		rxConfig.rx_config.idle_threshold = RX_IDLE;
+		rmt_config_t txConfig = RMT_DEFAULT_CONFIG_TX((gpio_num_t) pin, tx);
+		txConfig.clk_div = 80;
+		txConfig.tx_config.idle_output_en = true;
+		txConfig.tx_config.idle_level = RMT_IDLE_LEVEL_HIGH;
+
+		if (rmt_config(&rxConfig) != ESP_OK || rmt_driver_install(rx, 512, 0) != ESP_OK)
+			return false;
+		if (rmt_config(&txConfig) != ESP_OK || rmt_driver_install(tx, 0, 0) != ESP_OK) {
+			rmt_driver_uninstall(rx);
+			return false;
+		}
+		PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[pin]);
+		GPIO.pin[pin].pad_driver = 1;
+		rmt_get_ringbuf_handle(rx, &ring);
+		ready = true;
+		return true;
+	}
+
+	// count (1..8) time slots, LSB first. A 1 is a write-1 or read slot, a
+	// 0 a write-0 slot. Returns the bits sampled: a device answers 0 by
+	// holding the line low past the sample point.
+	uint8_t slots(uint8_t bits, uint8_t count) {
+		if (!begin())
+			return 0xff;
+		rmt_item32_t items[8];
+		for (auto i = 0; i < count; i++) {
+			bool one = bits & (1 << i);
+			items[i].level0 = 0;
+			items[i].duration0 = one ? ONE_LOW : ZERO_LOW;
+			items[i].level1 = 1;
+			items[i].duration1 = SLOT - items[i].duration0;
+		}
+		size_t n;
+		rmt_item32_t *got = transfer(items, count, n);
+		if (got == nullptr)
+			return 0xff;
+		uint8_t ret = 0;
+		for (auto i = 0; i < count; i++) {
+			if (i >= n || got[i].level0 != 0 || got[i].duration0 <= SAMPLE)
+				ret |= 1 << i;
+		}
+		release(got);
+		return ret;
+	}
+
+	rmt_item32_t* transfer(const rmt_item32_t *items, uint8_t count, size_t &n) {
+		rmt_rx_start(rx, true);
+		rmt_write_items(tx, items, count, true);
+		size_t len = 0;
+		auto got = (rmt_item32_t*) xRingbufferReceive(ring, &len, pdMS_TO_TICKS(10));
+		rmt_rx_stop(rx);
+		n = len / sizeof(rmt_item32_t);
+		return got;
+	}
+
+	void release(rmt_item32_t *got) {
+		if (got != nullptr)
+			vRingbufferReturnItem(ring, got);
+	}
+
+	// µs
+	static const uint16_t RESET_LOW = 480;
+	static const uint16_t RESET_HIGH = 70;
+	static const uint16_t SLOT = 70;
+	static const uint16_t ONE_LOW = 6;
+	static const uint16_t ZERO_LOW = 60;
+	static const uint16_t SAMPLE = 15 - 2;
+	static const uint16_t RX_IDLE = SLOT + 2;
+
+	static const uint8_t SEARCH_ROM = 0xf0;
+	static const uint8_t ALARM_SEARCH = 0xec;
+	static const uint8_t MATCH_ROM = 0x55;
+	static const uint8_t SKIP_ROM = 0xcc;
+
+	uint8_t pin;
+	rmt_channel_t tx;
+	rmt_channel_t rx;
+	RingbufHandle_t ring = nullptr;
+	bool ready = false;
+
+	uint8_t romNo[8] = { 0 };
+	uint8_t lastDiscrepancy = 0;
+	bool lastDeviceFlag = false;
+};
+
+} // namespace gemha
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <time.h>
+
+namespace gemha {
+
+// Store-and-forward queue in flash for samples taken while offline: a log
+// of SEGMENTS files used as a ring. Records are appended to the newest
+// segment and drained from the oldest; when the ring is full the oldest
+// segment is dropped whole and its records counted in droppedCount().
+// push() collects records in RAM and appends them BUFFER bytes at a time,
+// so flash sees few large writes and each segment is rewritten once per
+// round of the ring. The read position is saved at most every
+// STATE_INTERVAL ms, after a reboot up to that much may be sent again.
+// Drained samples go to <topic>/history as {"v":<payload>,"t":<unix time>},
+// without "t" when the clock wasn't set yet at push() time.
+template<uint8_t SEGMENTS = 8, uint16_t SEGMENT_SIZE = 4096>
+class Outbox {
+	static_assert(SEGMENTS >= 2, "at least two segments");
+public:
+	static const uint8_t TOPIC_MAX = 96;
+	static const uint8_t PAYLOAD_MAX = 24;
+
+	Outbox(const char *dir = "/outbox") : dir(dir) {
+	}
+
+	// Mounts the file system and picks up what the last boot left queued.
+	bool begin() {
+#ifdef ESP8266
+		if (!LittleFS.begin())
+			return false;
+#else
+		if (!LittleFS.begin(true))
+			return false;
+#endif
+		LittleFS.mkdir(dir);
+
+		uint32_t minSeq = UINT32_MAX;
+		uint32_t maxSeq = 0;
+		uint32_t seqs[SEGMENTS];
+		char p[32];
+		for (auto i = 0; i < SEGMENTS; i++) {
+			seqs[i] = 0;
+			path(p, i);
+			if (!LittleFS.exists(p))
+				continue;
+			File f = LittleFS.open(p, "r");
+			uint32_t seq = 0;
+			f.read((uint8_t*) &seq, sizeof(seq));
+			f.close();
+			if (seq == 0 || seq % SEGMENTS != uint32_t(i)) {
+				LittleFS.remove(p);
+				continue;
+			}
+			seqs[i] = seq;
+			minSeq = std::min(minSeq, seq);
+			maxSeq = std::max(maxSeq, seq);
+		}
+
+		uint32_t saved[2] = { 0, 0 }; // tail sequence, offset
+		statePath(p);
+		if (LittleFS.exists(p)) {
+			File f = LittleFS.open(p, "r");
+			f.read((uint8_t*) saved, sizeof(saved));
+			f.close();
+		}
+
+		headSeq = std::max(maxSeq, saved[0] > 0 ? saved[0] - 1 : 0);
+		tailSeq = std::max(minSeq == UINT32_MAX ? headSeq + 1 : minSeq, saved[0]);
+		tailSeq = std::max(tailSeq, headSeq >= SEGMENTS ? headSeq - SEGMENTS + 1 : 1);
+		tailOffset = tailSeq == saved[0] ? saved[1] : HEADER;
+		for (auto i = 0; i < SEGMENTS; i++) {
+			if (seqs[i] != 0 && (seqs[i] < tailSeq || seqs[i] > headSeq)) {
+				path(p, i);
+				LittleFS.remove(p);
+				seqs[i] = 0;
+			}
+			counts[i] = 0;
+			ends[i] = HEADER;
+		}
+		for (auto seq = tailSeq; seq <= headSeq; seq++)
+			scan(seq, seqs[slot(seq)] == seq);
+		stateSeq = tailSeq;
+		stateOffset = tailOffset;
+		return true;
+	}
+
+	// Drained at most one per interval ms on average, burst at a time.
+	// Interval 0 drains burst per drain() call.
+	void setRate(uint16_t interval, uint8_t burst) {
+		this->interval = interval;
+		this->burst = burst;
+	}
+
+	// False if the sample doesn't fit a record, it is counted as dropped.
+	bool push(const char *topic, const char *payload) {
+		size_t tl = strlen(topic);
+		size_t pl = strlen(payload);
+		if (tl >= TOPIC_MAX || pl >= PAYLOAD_MAX) {
+			dropped++;
+			return false;
+		}
+		uint16_t size = RECORD + tl + pl + 1;
+		if (bufLen + size > BUFFER)
+			flush();
+		uint8_t *r = buf + bufLen;
+		uint32_t t = unixTime();
+		memcpy(r, &t, sizeof(t));
+		r[4] = tl;
+		r[5] = pl;
+		memcpy(r + RECORD, topic, tl);
+		memcpy(r + RECORD + tl, payload, pl);
+		r[size - 1] = crc8(r, size - 1);
+		bufLen += size;
+		bufCount++;
+		return true;
+	}
+
+	// Writes what push() collected in RAM, e.g. before a planned reboot.
+	void flush() {
+		if (bufLen == 0)
+			return;
+		bool wasEmpty = empty();
+		bool fresh = wasEmpty || sealed || ends[slot(headSeq)] + bufLen > SEGMENT_SIZE;
+		if (fresh) {
+			if (!wasEmpty && headSeq - tailSeq + 1 == SEGMENTS)
+				dropTail();
+			headSeq++;
+			if (wasEmpty) {
+				tailSeq = headSeq;
+				tailOffset = HEADER;
+			}
+			counts[slot(headSeq)] = 0;
+			ends[slot(headSeq)] = HEADER;
+			sealed = false;
+		}
+		char p[32];
+		path(p, slot(headSeq));
+		File f = LittleFS.open(p, fresh ? "w" : "a");
+		size_t written = 0;
+		if (f) {
+			if (fresh)
+				f.write((const uint8_t*) &headSeq, sizeof(headSeq));
+			written = f.write(buf, bufLen);
+			f.close();
+		}
+		if (written == bufLen) {
+			ends[slot(headSeq)] += bufLen;
+			counts[slot(headSeq)] += bufCount;
+		} else {
+			dropped += bufCount;
+		}
+		bufLen = 0;
+		bufCount = 0;
+	}
+
+	// Publishes queued samples, call while connected. False when a publish
+	// failed, the sample stays queued.
+	bool drain(PubSubClient &client) {
+		if (empty() && bufLen == 0)
+			return true;
+		unsigned long now = millis();
+		uint32_t budget = interval == 0 ? burst : (now - drainAt) / interval;
+		if (budget == 0)
+			return true;
+		budget = std::min<uint32_t>(budget, burst);
+		drainAt = now;
+		flush();
+
+		bool ok = true;
+		File f;
+		uint32_t openSeq = 0;
+		char p[32];
+		while (budget > 0 && !empty()) {
+			uint8_t s = slot(tailSeq);
+			if (tailOffset >= ends[s]) {
+				f.close();
+				openSeq = 0;
+				path(p, s);
+				LittleFS.remove(p);
+				bool last = tailSeq == headSeq;
+				tailSeq++;
+				tailOffset = HEADER;
+				saveState();
+				if (last)
+					break;
+				continue;
+			}
+			if (openSeq != tailSeq) {
+				f.close();
+				path(p, s);
+				f = LittleFS.open(p, "r");
+				openSeq = tailSeq;
+			}
+			Record r;
+			uint16_t size = f ? read(f, tailOffset, ends[s], r) : 0;
+			if (size == 0) {
+				// unreadable, the rest of the segment is lost
+				dropped += counts[s];
+				counts[s] = 0;
+				tailOffset = ends[s];
+				continue;
+			}
+			if (!publish(client, r)) {
+				ok = false;
+				break;
+			}
+			tailOffset += size;
+			counts[s]--;
+			budget--;
+		}
+		f.close();
+		if ((tailSeq != stateSeq || tailOffset != stateOffset) && millis() - stateAt >= STATE_INTERVAL)
+			saveState();
+		return ok;
+	}
+
+	bool empty() const {
+		return tailSeq > headSeq;
+	}
+
+	uint32_t queuedCount() const {
+		uint32_t n = bufCount;
+		for (auto seq = tailSeq; seq <= headSeq; seq++)
+			n += counts[slot(seq)];
+		return n;
+	}
+
+	uint32_t droppedCount() const {
+		return dropped;
+	}
+private:
+	struct Record {
+		uint32_t time;
+		char topic[TOPIC_MAX];
+		char payload[PAYLOAD_MAX];
+	};
+
+	// Record size or 0 if the one at offset is cut off or corrupt.
+	static uint16_t read(File &f, uint16_t offset, uint16_t end, Record &r) {
+		uint8_t b[RECORD + TOPIC_MAX + PAYLOAD_MAX + 1];
+		if (offset + RECORD > end || !f.seek(offset) || f.read(b, RECORD) != RECORD)
+			return 0;
+		uint8_t tl = b[4];
+		uint8_t pl = b[5];
+		uint16_t size = RECORD + tl + pl + 1;
+		if (tl >= TOPIC_MAX || pl >= PAYLOAD_MAX || offset + size > end)
+			return 0;
+		if (f.read(b + RECORD, tl + pl + 1) != size_t(tl + pl + 1) || crc8(b, size - 1) != b[size - 1])
+			return 0;
+		memcpy(&r.time, b, sizeof(r.time));
+		memcpy(r.topic, b + RECORD, tl);
+		r.topic[tl] = 0;
+		memcpy(r.payload, b + RECORD + tl, pl);
+		r.payload[pl] = 0;
+		return size;
+	}
+
+	bool publish(PubSubClient &client, const Record &r) {
+		char topic[TOPIC_MAX + 8];
+		snprintf(topic, sizeof(topic), "%s/history", r.topic);
+		char msg[PAYLOAD_MAX + 24];
+		if (r.time != 0)
+			snprintf(msg, sizeof(msg), "{\"v\":%s,\"t\":%lu}", r.payload, (unsigned long) r.time);
+		else
+			snprintf(msg, sizeof(msg), "{\"v\":%s}", r.payload);
+		return client.publish(topic, msg);
+	}
+
+	// Counts the valid records of a segment left by the last boot. After a
+	// torn write the head segment is sealed, the next flush() starts a new
+	// one instead of appending behind the garbage.
+	void scan(uint32_t seq, bool exists) {
+		uint8_t s = slot(seq);
+		uint16_t size = 0;
+		uint16_t offset = HEADER;
+		if (exists) {
+			char p[32];
+			path(p, s);
+			File f = LittleFS.open(p, "r");
+			size = f.size();
+			uint16_t n;
+			Record r;
+			while ((n = read(f, offset, size, r)) != 0) {
+				offset += n;
+				if (seq != tailSeq || offset > tailOffset)
+					counts[s]++;
+			}
+			f.close();
+		}
+		ends[s] = offset;
+		if (seq == tailSeq)
+			tailOffset = std::min(tailOffset, offset);
+		if (seq == headSeq && offset != size)
+			sealed = true;
+	}
+
+	void dropTail() {
+		uint8_t s = slot(tailSeq);
+		dropped += counts[s];
+		counts[s] = 0;
+		char p[32];
+		path(p, s);
+		LittleFS.remove(p);
+		tailSeq++;
+		tailOffset = HEADER;
+	}
+
+	void saveState() {
+		char p[32];
+		statePath(p);
+		File f = LittleFS.open(p, "w");
+		if (!f)
+			return;
+		uint32_t saved[2] = { tailSeq, tailOffset };
+		f.write((const uint8_t*) saved, sizeof(saved));
+		f.close();
+		stateSeq = tailSeq;
+		stateOffset = tailOffset;
+		stateAt = millis();
+	}
+
+	uint8_t slot(uint32_t seq) const {
+		return seq % SEGMENTS;
+	}
+
+	void path(char *p, uint8_t slot) const {
+		snprintf(p, 32, "%s/%u", dir, slot);
+	}
+
+	void statePath(char *p) const {
+		snprintf(p, 32, "%s/state", dir);
+	}
+
+	// 0 until the clock was set, e.g. by SNTP
+	static uint32_t unixTime() {
+		time_t t = time(nullptr);
+		return t > 1600000000 ? t : 0;
+	}
+
+	// Dallas/Maxim, as the 1-Wire ROMs
+	static uint8_t crc8(const uint8_t *p, uint16_t len) {
+		uint8_t crc = 0;
+		while (len--) {
+			uint8_t b = *p++;
+			for (auto i = 0; i < 8; i++) {
+				bool mix = (crc ^ b) & 1;
+				crc >>= 1;
+				if (mix)
+					crc ^= 0x8c;
+				b >>= 1;
+			}
+		}
+		return crc;
+	}
+
+	static const uint16_t HEADER = 4;  // sequence number of the segment
+	static const uint8_t RECORD = 6;   // time, topic and payload length
+	static const uint16_t BUFFER = 512;
+	static const uint32_t STATE_INTERVAL = 10000;
+
+	const char *dir;
+
+	uint32_t tailSeq = 1;     // oldest segment
+	uint16_t tailOffset = HEADER;
+	uint32_t headSeq = 0;     // segment written to, empty while below tailSeq
+	uint16_t counts[SEGMENTS];
+	uint16_t ends[SEGMENTS];  // valid bytes of each segment
+	bool sealed = false;
+
+	uint8_t buf[BUFFER];
+	uint16_t bufLen = 0;
+	uint16_t bufCount = 0;
+
+	uint16_t interval = 50;
+	uint8_t burst = 10;
+	unsigned long drainAt = 0;
+
+	uint32_t stateSeq = 0;
+	uint16_t stateOffset = 0;
+	unsigned long stateAt = 0;
+	uint32_t dropped = 0;
+};
+
+} // namespace gemha
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <limits.h>
+
+namespace gemha {
+
+// Parsers straight off the (payload, length) of a message: no copy, no
+// terminator needed, no locale. Blanks around the value are ignored.
+enum ParseResult {
+	PARSE_OK,
+	PARSE_EMPTY,
+	PARSE_SYNTAX,
+	PARSE_RANGE
+};
+
+inline bool isBlank(byte c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline byte lowerAscii(byte c) {
+	return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+inline void trimBlanks(const byte *&p, const byte *&end) {
+	while (p < end && isBlank(*p))
+		p++;
+	while (end > p && isBlank(end[-1]))
+		end--;
+}
+
+// A decimal with up to decimals places as an integer in units of
+// 10^-decimals: "21.5" with 2 decimals is 2150. More places are rounded
+// half away from zero. With 0 decimals a point is a syntax error.
+inline ParseResult parseFixed(const byte *payload, unsigned int length, uint8_t decimals,
+		long min, long max, long &value) {
+	const byte *p = payload;
+	const byte *end = payload + length;
+	trimBlanks(p, end);
+	if (p == end)
+		return PARSE_EMPTY;
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+
+	// saturates, so an overflow comes out as a range error below
+	const unsigned long LIMIT = ULONG_MAX / 10 - 1;
+	unsigned long v = 0;
+	bool digits = false;
+	bool point = false;
+	bool roundUp = false;
+	uint8_t places = 0;
+	for (; p < end; p++) {
+		byte c = *p;
+		if (c == '.' && !point && decimals > 0) {
+			point = true;
+			continue;
+		}
+		if (c < '0' || c > '9')
+			return PARSE_SYNTAX;
+		digits = true;
+		if (point && places >= decimals) {
+			// only the first place past decimals counts, for rounding
+			if (places == decimals) {
+				roundUp = c >= '5';
+				places++;
+			}
+			continue;
+		}
+		if (point)
+			places++;
+		v = v > LIMIT ? ULONG_MAX : v * 10 + (c - '0');
+	}
+	if (!digits)
+		return PARSE_SYNTAX;
+	for (; places < decimals; places++)
+		v = v > LIMIT ? ULONG_MAX : v * 10;
+	if (roundUp && v < ULONG_MAX)
+		v++;
+
+	long s;
+	if (negative) {
+		if (v > (unsigned long) LONG_MAX + 1)
+			return PARSE_RANGE;
+		s = v == (unsigned long) LONG_MAX + 1 ? LONG_MIN : -long(v);
+	} else {
+		if (v > (unsigned long) LONG_MAX)
+			return PARSE_RANGE;
+		s = v;
+	}
+	if (s < min || s > max)
+		return PARSE_RANGE;
+	value = s;
+	return PARSE_OK;
+}
+
+inline ParseResult parseInt(const byte *payload, unsigned int length, long min, long max, long &value) {
+	return parseFixed(payload, length, 0, min, max, value);
+}
+
+// index of the name the payload equals, ignoring ASCII case
+inline ParseResult parseEnum(const byte *payload, unsigned int length,
+		const char *const *names, uint8_t count, uint8_t &value) {
+	const byte *p = payload;
+	const byte *end = payload + length;
+	trimBlanks(p, end);
+	if (p == end)
+		return PARSE_EMPTY;
+	for (uint8_t i = 0; i < count; i++) {
+		const char *n = names[i];
+		const byte *q = p;
+		for (; q < end && *n != 0; q++, n++) {
+			if (lowerAscii(*q) != lowerAscii(*n))
+				break;
+		}
+		if (q == end && *n == 0) {
+			value = i;
+			return PARSE_OK;
+		}
+	}
+	return PARSE_RANGE;
+}
+
+template<size_t N>
+inline ParseResult parseEnum(const byte *payload, unsigned int length,
+		const char *const (&names)[N], uint8_t &value) {
+	static_assert(N < 256, "at most 255 names");
+	return parseEnum(payload, length, names, N, value);
+}
+
+// 1/0, true/false, on/off
+inline ParseResult parseBool(const byte *payload, unsigned int length, bool &value) {
+	static const char *const names[] = { "0", "false", "off", "1", "true", "on" };
+	uint8_t i;
+	ParseResult ret = parseEnum(payload, length, names, i);
+	if (ret == PARSE_OK)
+		value = i >= 3;
+	return ret;
+}
+
+// a non-negative integer, -1 for anything else
+inline int getValue(const byte *payload, unsigned int length) {
+	long value;
+	if (parseInt(payload, length, 0, INT_MAX, value) != PARSE_OK)
+		return -1;
+	return value;
+}
+
+} // namespace gemha
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Arduino.h"
+
+namespace gemha {
+
+// Report on change: a value is due when it moved more than the deadband
+// since the last report or nothing was reported for maxSilence ms.
+// Call sent() once the publish succeeded, a failed one is retried on the
+// next due().
+template<typename T>
+class Report {
+public:
+	Report(T deadband = T(), uint32_t maxSilence = 300000) :
+			deadband(deadband), maxSilence(maxSilence) {
+	}
+
+	void set(T deadband, uint32_t maxSilence) {
+		this->deadband = deadband;
+		this->maxSilence = maxSilence;
+	}
+
+	bool due(T value, bool force = false) {
+		if (force || !valid || millis() - lastAt >= maxSilence
+				|| (value > last ? value - last : last - value) > deadband)
+			return true;
+		suppressed++;
+		return false;
+	}
+
+	void sent(T value) {
+		last = value;
+		lastAt = millis();
+		valid = true;
+	}
+
+	// next due() reports whatever the value is, e.g. after a reconnect
+	void reset() {
+		valid = false;
+	}
+
+	uint32_t suppressedCount() const {
+		return suppressed;
+	}
+private:
+	T deadband;
+	uint32_t maxSilence;
+	T last = T();
+	unsigned long lastAt = 0;
+	bool valid = false;
+	uint32_t suppressed = 0;
+};
+
+} // namespace gemha
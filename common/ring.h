@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace gemha {
+
+// Lock-free single producer, single consumer queue. push() may only be
+// called from one task (or ISR), peek()/pop()/clear() only from one other
+// task.
+// When full, push() drops the new element and counts it.
+template<typename T, uint32_t N>
+class SpscRing {
+	static_assert(N && (N & (N - 1)) == 0, "N must be a power of 2");
+public:
+	bool push(const T &v) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == N) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		buf[h & (N - 1)] = v;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &v) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return false;
+		v = buf[t & (N - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// the oldest element, left in the queue until pop()
+	bool peek(T &v) const {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return false;
+		v = buf[t & (N - 1)];
+		return true;
+	}
+
+	void clear() {
+		tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	bool empty() const {
+		return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire);
+	}
+
+	uint32_t droppedCount() const {
+		return dropped.load(std::memory_order_relaxed);
+	}
+private:
+	T buf[N];
+	std::atomic<uint32_t> head { 0 };
+	std::atomic<uint32_t> tail { 0 };
+	std::atomic<uint32_t> dropped { 0 };
+};
+
+} // namespace gemha
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Arduino.h"
+#include "payload.h"
+
+#include <string.h>
+
+namespace gemha {
+
+// What a handler gets: the numbers of the + levels, in order, and the
+// payload.
+struct TopicMatch {
+	static const uint8_t ARGS_MAX = 2;
+	int arg[ARGS_MAX];
+	const byte *payload;
+	unsigned int length;
+
+	// the payload as a number, -1 if it isn't one
+	int value() const {
+		return getValue(payload, length);
+	}
+};
+
+typedef void (*TopicHandler)(const TopicMatch &match);
+
+// + stands for a whole level, at most ARGS_MAX of them, # for the rest
+// of the topic after a /
+constexpr bool validTopicPattern(const char *p, uint8_t args = 0, bool levelStart = true) {
+	return *p == 0 ? true
+			: *p == '+' ? levelStart && (p[1] == '/' || p[1] == 0) && args < TopicMatch::ARGS_MAX
+					&& validTopicPattern(p + 1, args + 1, false)
+			: *p == '#' ? levelStart && p[1] == 0
+			: validTopicPattern(p + 1, args, *p == '/');
+}
+
+// not constexpr: reaching it in a constant expression fails the build
+inline const char* invalidTopicPattern(const char *pattern) {
+	return pattern;
+}
+
+// characters two patterns have in common up to the first wildcard
+constexpr uint16_t literalPrefix(const char *a, const char *b, uint16_t n = 0) {
+	return *a != 0 && *a == *b && *a != '+' && *a != '#' ? literalPrefix(a + 1, b + 1, n + 1) : n;
+}
+
+// characters before the first wildcard
+constexpr uint16_t literalLength(const char *p, uint16_t n = 0) {
+	return *p != 0 && *p != '+' && *p != '#' ? literalLength(p + 1, n + 1) : n;
+}
+
+// A topic pattern and its handler. A + level matches a decimal number,
+// up to 9 digits, which is passed on in TopicMatch::arg.
+struct TopicRoute {
+	constexpr TopicRoute(const char *pattern, TopicHandler handler) :
+			pattern(validTopicPattern(pattern) ? pattern : invalidTopicPattern(pattern)),
+			handler(handler) {
+	}
+
+	const char *pattern;
+	TopicHandler handler;
+};
+
+template<size_t... I>
+struct IndexList {
+};
+
+template<size_t N, size_t... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {
+};
+
+template<size_t... I>
+struct MakeIndexList<0, I...> {
+	typedef IndexList<I...> type;
+};
+
+// The routes with the length of their literal part and the prefix all
+// of them share, worked out by the compiler when the router is constexpr.
+// dispatch() takes the topic's length once, compares the shared prefix
+// once, and then each route's literal rest with a single memcmp, after a
+// one character check; only + and # levels are read character by
+// character. The first matching route wins.
+//
+//   constexpr gemha::TopicRoute routes[] = {
+//       { "house/vent/rescan", onRescan },
+//       { "house/vent/valve/+", onValve },
+//   };
+//   constexpr auto router = gemha::topicRouter(routes);
+//
+// A malformed pattern in a constexpr table doesn't compile.
+template<size_t N>
+class TopicRouter {
+public:
+	constexpr TopicRouter(const TopicRoute (&routes)[N]) :
+			TopicRouter(routes, typename MakeIndexList<N>::type()) {
+	}
+
+	// calls the handler of the route matching the topic, false if none does
+	bool dispatch(const char *topic, const byte *payload, unsigned int length) const {
+		if (strncmp(topic, routes[0].pattern, common) != 0)
+			return false;
+		for (size_t i = 0; i < N; i++) {
+			const char *p = routes[i].pattern;
+			uint16_t k = literal[i];
+			// the topic holds at least k characters once these match
+			if (k > common && (topic[common] != p[common]
+					|| strncmp(topic + common + 1, p + common + 1, k - common - 1) != 0))
+				continue;
+			TopicMatch match = TopicMatch();
+			if (!matchRest(p + k, topic + k, match))
+				continue;
+			match.payload = payload;
+			match.length = length;
+			routes[i].handler(match);
+			return true;
+		}
+		return false;
+	}
+private:
+	template<size_t... I>
+	constexpr TopicRouter(const TopicRoute (&routes)[N], IndexList<I...>) :
+			routes { routes[I]... },
+			literal { literalLength(routes[I].pattern)... },
+			common(sharedPrefix(routes)) {
+	}
+
+	// the literal prefix of routes[0] that all routes share
+	static constexpr uint16_t sharedPrefix(const TopicRoute (&routes)[N], size_t i = 1, uint16_t n = 0xffff) {
+		return i == N ? (N == 1 ? literalLength(routes[0].pattern) : n)
+				: sharedPrefix(routes, i + 1,
+						n < literalPrefix(routes[0].pattern, routes[i].pattern) ? n
+								: literalPrefix(routes[0].pattern, routes[i].pattern));
+	}
+
+	static bool matchRest(const char *p, const char *t, TopicMatch &match) {
+		uint8_t args = 0;
+		for (;; p++, t++) {
+			if (*p == '#')
+				return true;
+			if (*p == '+') {
+				int v = 0;
+				uint8_t digits = 0;
+				for (; *t >= '0' && *t <= '9' && digits < 9; t++, digits++)
+					v = v * 10 + *t - '0';
+				if (digits == 0)
+					return false;
+				match.arg[args++] = v;
+				p++;
+			}
+			if (*p != *t)
+				return false;
+			if (*p == 0)
+				return true;
+		}
+	}
+
+	TopicRoute routes[N];
+	uint16_t literal[N];
+	uint16_t common;
+};
+
+template<size_t N>
+constexpr TopicRouter<N> topicRouter(const TopicRoute (&routes)[N]) {
+	return TopicRouter<N>(routes);
+}
+
+} // namespace gemha
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "Arduino.h"
+#include "batch.h"
+#include "esp_timer.h"
+
+#include <esp_task_wdt.h>
+#include <PubSubClient.h>
+
+namespace gemha {
+
+// The WiFi driver and lwIP run on core 0. The network task, MQTT and OTA,
+// joins them there; core 1 is left to sampling and control.
+static const BaseType_t NET_CORE = 0;
+static const BaseType_t APP_CORE = 1;
+
+// A task as a sketch declares it, priority and core included. Higher
+// priorities run first.
+struct TaskSpec {
+	const char *name;
+	TaskFunction_t code;
+	uint32_t stack;
+	UBaseType_t priority;
+	BaseType_t core;
+	void *param;
+};
+
+// The tasks started through here and the CPU time each one used. A task
+// counts as busy except inside taskWait() and taskDelay(): a plain delay()
+// or blocking call counts as busy, so does preemption by a higher priority
+// task on the same core. Counters are 32 bit microseconds, they wrap
+// after 71 minutes; reports only use differences.
+class TaskTable {
+public:
+	static const uint8_t TASKS_MAX = 8;
+
+	struct Task {
+		const char *name;
+		TaskHandle_t handle;
+		bool used;
+		volatile uint32_t busyUs;
+		volatile uint32_t resumedAt;
+		uint32_t reportedUs; // owned by the reporting task
+	};
+
+	bool start(const TaskSpec &spec, TaskHandle_t *handle = nullptr) {
+		Task *t = nullptr;
+		for (auto &task : tasks) {
+			if (!task.used) {
+				t = &task;
+				break;
+			}
+		}
+		if (t == nullptr)
+			return false;
+		t->name = spec.name;
+		t->handle = nullptr;
+		t->busyUs = 0;
+		t->reportedUs = 0;
+		t->resumedAt = esp_timer_get_time();
+		t->used = true;
+		// the handle is set before the task first runs, current() finds it
+		if (xTaskCreatePinnedToCore(spec.code, spec.name, spec.stack, spec.param,
+				spec.priority, &t->handle, spec.core) != pdPASS) {
+			t->used = false;
+			return false;
+		}
+		if (handle != nullptr)
+			*handle = t->handle;
+		return true;
+	}
+
+	void stop(TaskHandle_t handle) {
+		for (auto &task : tasks) {
+			if (task.used && task.handle == handle)
+				task.used = false;
+		}
+		vTaskDelete(handle);
+	}
+
+	// the calling task, nullptr when it wasn't started here
+	Task* current() {
+		TaskHandle_t self = xTaskGetCurrentTaskHandle();
+		for (auto &task : tasks) {
+			if (task.used && task.handle == self)
+				return &task;
+		}
+		return nullptr;
+	}
+
+	// Percent of its core each task used since the last call, in start
+	// order. Returns the number of tasks.
+	uint8_t sample(const char **names, float *percent) {
+		uint32_t now = esp_timer_get_time();
+		// the caller is running, take its time up to now
+		Task *self = current();
+		if (self != nullptr) {
+			self->busyUs += now - self->resumedAt;
+			self->resumedAt = now;
+		}
+		uint32_t window = now - sampledAt;
+		sampledAt = now;
+		uint8_t n = 0;
+		for (auto &task : tasks) {
+			if (!task.used)
+				continue;
+			uint32_t busy = task.busyUs;
+			names[n] = task.name;
+			percent[n++] = window > 0 ? (busy - task.reportedUs) * 100.0f / window : 0;
+			task.reportedUs = busy;
+		}
+		return n;
+	}
+private:
+	Task tasks[TASKS_MAX] = { };
+	uint32_t sampledAt = 0;
+};
+
+inline TaskTable& taskTable() {
+	static TaskTable table;
+	return table;
+}
+
+inline bool startTask(const TaskSpec &spec, TaskHandle_t *handle = nullptr) {
+	return taskTable().start(spec, handle);
+}
+
+template<size_t N>
+inline bool startTasks(const TaskSpec (&specs)[N]) {
+	bool ret = true;
+	for (auto &spec : specs)
+		ret &= startTask(spec);
+	return ret;
+}
+
+inline void stopTask(TaskHandle_t handle) {
+	taskTable().stop(handle);
+}
+
+// Stops the calling task's CPU clock for as long as it lives.
+class TaskPause {
+public:
+	TaskPause() : task(taskTable().current()) {
+		if (task != nullptr)
+			task->busyUs += uint32_t(esp_timer_get_time()) - task->resumedAt;
+	}
+
+	~TaskPause() {
+		if (task != nullptr)
+			task->resumedAt = esp_timer_get_time();
+	}
+private:
+	TaskTable::Task *task;
+};
+
+// Runs wait, e.g. a blocking take, as time the task didn't use:
+// gemha::taskWait([] { return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)); });
+template<typename F>
+auto taskWait(F wait) -> decltype(wait()) {
+	TaskPause pause;
+	return wait();
+}
+
+inline void taskDelay(uint32_t ms) {
+	TaskPause pause;
+	delay(ms);
+}
+
+// For loop() once the tasks run. initWiFi() put Arduino's loopTask under
+// the task watchdog, it leaves it before it goes; runNetwork() puts the
+// network task under it instead.
+inline void endLoopTask() {
+	esp_task_wdt_delete(nullptr);
+	vTaskDelete(nullptr);
+}
+
+// The network task's body: loopFn, MQTT and OTA, what loop() did, every
+// periodMs next to the WiFi driver. The task is under the watchdog, reset
+// once per pass.
+template<typename F>
+void runNetwork(F loopFn, uint32_t periodMs) {
+	esp_task_wdt_add(nullptr);
+	for (;;) {
+		esp_task_wdt_reset();
+		loopFn();
+		taskDelay(periodMs);
+	}
+}
+
+// The CPU share of every task since the last report, {"net":2.1,...} in
+// percent of its core.
+inline bool publishCpu(PubSubClient &client, const char *topic) {
+	const char *names[TaskTable::TASKS_MAX];
+	float percent[TaskTable::TASKS_MAX];
+	uint8_t n = taskTable().sample(names, percent);
+	return publishBatch(client, topic, [&](Batch &batch) {
+		for (auto i = 0; i < n; i++)
+			batch.add(names[i], percent[i], 1);
+	});
+}
+
+} // namespace gemha
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <PubSubClient.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace gemha {
+
+// Lower goes first
+enum Priority {
+	PRIORITY_ACK,		// answers to a command
+	PRIORITY_CHANGE,	// state changes, e.g. an input event
+	PRIORITY_TELEMETRY,	// periodic and forced full state, readings
+	PRIORITIES
+};
+
+// Outgoing messages of one connection, sent from loop() by priority and
+// paced by a token bucket. A message posted for a topic that is still
+// queued replaces the queued payload in place, keeping the higher of both
+// priorities: a burst of full states after a reconnect costs one publish
+// per topic, not one per burst. Acks don't wait for tokens.
+// When all SLOTS are taken a message pushes out the oldest of a lower or
+// equal priority class, if there is one, otherwise it is dropped.
+class Scheduler {
+public:
+	static const uint8_t SLOTS = 32;
+	static const uint8_t TOPIC_MAX = 64;
+	static const uint8_t PAYLOAD_MAX = 32;
+
+	// one publish per interval ms on average, up to burst at once
+	void setRate(uint16_t interval, uint8_t burst) {
+		this->interval = interval;
+		this->burst = burst;
+		tokens = burst;
+		refillAt = millis();
+	}
+
+	// False if the message is too long or had no room, it is dropped.
+	bool post(const char *topic, const uint8_t *payload, unsigned int length,
+			Priority priority, bool retained = false) {
+		size_t tl = strlen(topic);
+		if (tl >= TOPIC_MAX || length > PAYLOAD_MAX) {
+			dropped++;
+			return false;
+		}
+		uint16_t h = hash(topic);
+		int s = find(topic, h);
+		if (s >= 0) {
+			coalesced++;
+			if (priority > slots[s].priority)
+				priority = Priority(slots[s].priority);
+		} else {
+			s = freeSlot(priority);
+			if (s < 0) {
+				dropped++;
+				return false;
+			}
+			memcpy(slots[s].topic, topic, tl + 1);
+			slots[s].hash = h;
+			slots[s].seq = nextSeq++;
+			used++;
+		}
+		Slot &slot = slots[s];
+		memcpy(slot.payload, payload, length);
+		slot.length = length;
+		slot.priority = priority;
+		slot.retained = retained;
+		return true;
+	}
+
+	bool post(const char *topic, const char *payload, Priority priority, bool retained = false) {
+		return post(topic, (const uint8_t*) payload, strlen(payload), priority, retained);
+	}
+
+	// Call from loop(). Publishes what the bucket allows, a refused publish
+	// stays queued and ends the round. False if one was refused.
+	bool run(PubSubClient &client) {
+		refill();
+		while (used > 0) {
+			int s = next();
+			Slot &slot = slots[s];
+			if (slot.priority != PRIORITY_ACK && tokens == 0)
+				return true;
+			if (!client.publish(slot.topic, slot.payload, slot.length, slot.retained))
+				return false;
+			if (tokens > 0)
+				tokens--;
+			sent[slot.priority]++;
+			slot.topic[0] = 0;
+			used--;
+		}
+		return true;
+	}
+
+	// e.g. when the session is gone for good
+	void clear() {
+		for (auto &slot : slots)
+			slot.topic[0] = 0;
+		used = 0;
+	}
+
+	bool empty() const {
+		return used == 0;
+	}
+
+	uint8_t size() const {
+		return used;
+	}
+
+	uint32_t sentCount(Priority priority) const {
+		return sent[priority];
+	}
+
+	// updates merged into one still queued
+	uint32_t coalescedCount() const {
+		return coalesced;
+	}
+
+	uint32_t droppedCount() const {
+		return dropped;
+	}
+private:
+	struct Slot {
+		char topic[TOPIC_MAX]; // empty when free
+		uint8_t payload[PAYLOAD_MAX];
+		uint8_t length;
+		uint8_t priority;
+		bool retained;
+		uint16_t hash;
+		uint32_t seq;
+	};
+
+	static uint16_t hash(const char *topic) {
+		uint16_t h = 0;
+		while (*topic)
+			h = h * 31 + *topic++;
+		return h;
+	}
+
+	int find(const char *topic, uint16_t h) const {
+		if (used == 0)
+			return -1;
+		for (auto i = 0; i < SLOTS; i++) {
+			if (slots[i].topic[0] != 0 && slots[i].hash == h && strcmp(slots[i].topic, topic) == 0)
+				return i;
+		}
+		return -1;
+	}
+
+	// a free slot, or the oldest of the lowest class not above priority
+	int freeSlot(Priority priority) {
+		int victim = -1;
+		for (auto i = 0; i < SLOTS; i++) {
+			const Slot &slot = slots[i];
+			if (slot.topic[0] == 0)
+				return i;
+			if (slot.priority < priority)
+				continue;
+			if (victim < 0 || slot.priority > slots[victim].priority
+					|| (slot.priority == slots[victim].priority && int32_t(slot.seq - slots[victim].seq) < 0))
+				victim = i;
+		}
+		if (victim >= 0) {
+			dropped++;
+			slots[victim].topic[0] = 0;
+			used--;
+		}
+		return victim;
+	}
+
+	// highest priority, oldest first
+	int next() const {
+		int best = -1;
+		for (auto i = 0; i < SLOTS; i++) {
+			const Slot &slot = slots[i];
+			if (slot.topic[0] == 0)
+				continue;
+			if (best < 0 || slot.priority < slots[best].priority
+					|| (slot.priority == slots[best].priority && int32_t(slot.seq - slots[best].seq) < 0))
+				best = i;
+		}
+		return best;
+	}
+
+	void refill() {
+		unsigned long now = millis();
+		if (interval == 0) {
+			tokens = burst;
+			return;
+		}
+		uint32_t n = (now - refillAt) / interval;
+		if (n == 0)
+			return;
+		refillAt += n * interval;
+		tokens = std::min<uint32_t>(tokens + n, burst);
+	}
+
+	Slot slots[SLOTS] = { };
+	uint8_t used = 0;
+	uint32_t nextSeq = 0;
+	uint16_t interval = 20;
+	uint8_t burst = 5;
+	uint8_t tokens = 5;
+	unsigned long refillAt = 0;
+	uint32_t sent[PRIORITIES] = { };
+	uint32_t coalesced = 0;
+	uint32_t dropped = 0;
+};
+
+} // namespace gemha
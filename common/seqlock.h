@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace gemha {
+
+// Single writer, any number of readers, nobody waits on a lock. The value
+// is kept twice: the sequence is bumped before each copy is written, so
+// readers always take the copy which is not being written and retry only
+// if the writer got to it meanwhile. A writer preempted halfway does not
+// hold readers up.
+template<typename T>
+class SeqLock {
+public:
+	// writer side, one task only
+	void store(const T &v) {
+		uint32_t s = seq.load(std::memory_order_relaxed);
+		// readers go to buf[1] on the odd value, the last call's write to
+		// it has to be visible first
+		seq.store(s + 1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_release);
+		buf[0] = v;
+		seq.store(s + 2, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_release);
+		buf[1] = v;
+	}
+
+	T load() const {
+		T v;
+		uint32_t s;
+		do {
+			s = seq.load(std::memory_order_acquire);
+			v = buf[s & 1];
+			std::atomic_thread_fence(std::memory_order_acquire);
+		} while (seq.load(std::memory_order_relaxed) != s);
+		return v;
+	}
+private:
+	T buf[2];
+	std::atomic<uint32_t> seq { 0 };
+};
+
+} // namespace gemha
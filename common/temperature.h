@@ -1,72 +1,284 @@
 #pragma once
 
 #include "Arduino.h"
+#include "cbor.h"
+#include "report.h"
+#include "scheduler.h"
+#include "seqlock.h"
 
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <PubSubClient.h>
+#ifndef ESP8266
+#include <Preferences.h>
+#endif
+
+#include <initializer_list>
 
 namespace gemha {
 
-class Temperature {
+// DS18x20 sensors on one 1-Wire bus. N is the number of slots: a sensor
+// keeps its slot (index into snapshot().devices) for as long as it is
+// known, also while it doesn't answer, and across reboots through NVS.
+// A new sensor takes a free slot or the one of a sensor which is gone.
+// Bus is OneWire or anything with the same interface, e.g. RmtOneWire.
+template<uint8_t N, typename Bus = OneWire>
+class BasicTemperature {
+	static_assert(N > 0 && N < 128, "N must be 1..127");
 public:
-	Temperature(const char *topic, OneWire *oneWire, PubSubClient *client) :
-			topic(topic), oneWire(oneWire), sensors(oneWire), client(client) {
-		topicLen = strlen(topic);
+	static const uint8_t ADDRESS_MAX = N;
+	struct Device {
+		DeviceAddress addr; // all zero for an unused slot
+		float val;          // DEVICE_DISCONNECTED_C while not answering
+	};
+	// consistent copy of all readings, see snapshot()
+	struct Snapshot {
+		uint8_t count; // slots in use, missing sensors included
+		Device devices[N];
+	};
+
+	// key names the ROM table in NVS, give each bus its own
+	BasicTemperature(const char *topic, Bus *oneWire, PubSubClient *client, const char *key = "temp") :
+			topic(topic), oneWire(oneWire), client(client), key(key) {
+		// room left for the 16 hex digits of the ROM
+		topicLen = std::min<size_t>(strlen(topic), TOPIC_MAX - 17);
+		clear();
 	}
 
+	// Resolution (9..12 bits) for every sensor on the bus, 0 keeps what the
+	// sensors have. Call before start(), lower bits shorten the conversion.
+	void setResolution(uint8_t bits) {
+		busResolution = validResolution(bits);
+	}
+
+	// Resolution for one sensor, overrides the bus setting.
+	bool setResolution(const DeviceAddress addr, uint8_t bits) {
+		for (auto i = 0; i < settingCount; i++) {
+			if (std::equal(addr, addr + 8, settings[i].addr)) {
+				settings[i].bits = validResolution(bits);
+				return true;
+			}
+		}
+		if (settingCount == N)
+			return false;
+		std::copy(addr, addr + 8, settings[settingCount].addr);
+		settings[settingCount++].bits = validResolution(bits);
+		return true;
+	}
+
+	// Values are published when they moved more than deadband °C or after
+	// maxSilence ms, default 0.2 °C / 5 min.
+	void setReport(float deadband, uint32_t maxSilence) {
+		for (auto &p : published)
+			p.report.set(deadband, maxSilence);
+	}
+
+	// TEXT publishes "21.5", CBOR a half precision float
+	void setEncoding(Encoding encoding) {
+		this->encoding = encoding;
+	}
+
+	// readings go through the scheduler, as telemetry, instead of straight
+	// to the client
+	void setScheduler(Scheduler *scheduler) {
+		this->scheduler = scheduler;
+	}
+
+	// readings held back by the report policy since start
+	uint32_t suppressedCount() const {
+		uint32_t n = 0;
+		for (auto &p : published)
+			n += p.report.suppressedCount();
+		return n;
+	}
+
+	// Hysteresis mode for large, mostly stable buses: TH/TL of every sensor
+	// are set to degrees °C around its last reading and read() only reads
+	// the sensors an alarm search returns, one search instead of a
+	// scratchpad per sensor. All sensors are still read every fullRead ms.
+	// 0 turns it off.
+	void setAlarmBand(uint8_t degrees, uint32_t fullRead = 60000) {
+		alarmBand = degrees;
+		fullReadInterval = fullRead;
+		alarmArmed = false;
+	}
+
+	// Takes the ROM table saved by the last search and searches the bus
+	// only if one of those sensors doesn't answer.
 	void start() {
-		sensors.begin();
+		parasite = readPowerSupply();
+		load();
+		if (!verify())
+			search();
+		commit();
+	}
+
+	// Readings as of the last search() or read(). Safe from any task while
+	// the measuring task writes: never blocks, never returns torn values.
+	Snapshot snapshot() const {
+		return readings.load();
 	}
 
 	void readAll() {
-		search();
+		if (searchNeeded())
+			search();
 		startMeasure();
 		read();
 	}
 
 	void log(Print& p) {
 		p.print(" Temperatures: ");
-		p.print(addressCount);
+		p.print(snapshot().count);
+		p.print(" suppressed: ");
+		p.print(suppressedCount());
+	}
+
+	// Full search is needed after a sensor failed to answer with a valid
+	// CRC, on request (mqtt rescan) or while no sensor answers.
+	bool searchNeeded() const {
+		return rescan || presentCount == 0;
+	}
+
+	void requestSearch() {
+		rescan = true;
 	}
 
 	void search() {
+		rescan = false;
+		bool changed = false;
 		oneWire->reset();
 		oneWire->reset_search();
 
-		uint8_t prevCount = addressCount;
-		uint8_t count = 0;
+		for (auto &p : present)
+			p = false;
+		// new sensors get a slot only once the whole bus was seen, a slot
+		// not marked present by then is really gone
+		DeviceAddress found[N];
+		uint8_t foundCount = 0;
 		DeviceAddress addr;
-		while (count < ADDRESS_MAX
-				&& oneWire->search(addr)) {
-			if (sensors.validAddress(addr)) {
-				if (sensors.validFamily(addr)) {
-					if (!std::equal(addr, addr + 8, devices[count].addr)) {
-						addressCount = 0;
-						std::copy(addr, addr + 8, devices[count].addr);
-						devices[count].val = -127.0;
-					}
-
-					count++;
+		while (oneWire->search(addr)) {
+			if (OneWire::crc8(addr, 7) == addr[7]) {
+				if (validFamily(addr)) {
+					int slot = find(addr);
+					if (slot >= 0)
+						present[slot] = true;
+					else if (foundCount < N)
+						std::copy(addr, addr + 8, found[foundCount++]);
 				}
 			}
 		}
-		for (int i = count; i < prevCount; i++) {
-			devices[i].val = -127.0;
+		for (auto i = 0; i < foundCount; i++) {
+			int slot = assign(found[i]);
+			if (slot < 0)
+				break;
+			present[slot] = true;
+			changed = true;
+		}
+		for (auto i = 0; i < slotCount; i++) {
+			if (!present[i])
+				devices[i].val = DEVICE_DISCONNECTED_C;
+		}
+
+		verify();
+		if (changed)
+			save();
+		alarmArmed = false;
+		commit();
+	}
+
+	// Slot of a known sensor or -1, constant time.
+	int find(const DeviceAddress addr) const {
+		for (uint16_t h = hash(addr);; h = (h + 1) & (HASH_SIZE - 1)) {
+			uint8_t slot = index[h];
+			if (slot == 0)
+				return -1;
+			if (std::equal(addr, addr + 8, devices[slot - 1].addr))
+				return slot - 1;
 		}
-		addressCount = count;
 	}
 
 	void startMeasure() {
-		sensors.requestTemperatures();
+		startConversion();
+		delay(conversionTime);
+	}
+
+	// Non-blocking measure: starts the conversion and returns at once.
+	// Call read() when ready() reports the conversion finished.
+	void startConversion() {
+		oneWire->reset();
+		oneWire->skip();
+		oneWire->write(CONVERT_T, parasite);
+		conversionStart = millis();
+		conversionTime = conversionMillis(resolution);
+	}
+
+	bool ready() {
+		if (millis() - conversionStart >= conversionTime)
+			return true;
+		// parasite powered sensors can't signal the end of conversion
+		return !parasite && oneWire->read_bit() == 1;
 	}
 
 	void read() {
-		for (auto i = 0; i < addressCount; i++) {
-			devices[i].val = sensors.getTempC(devices[i].addr);
+		if (alarmBand == 0 || !alarmArmed || millis() - fullReadAt >= fullReadInterval) {
+			for (auto i = 0; i < slotCount; i++) {
+				if (present[i])
+					readSensor(i);
+			}
+			fullReadAt = millis();
+			alarmArmed = alarmBand != 0;
+		} else {
+			oneWire->reset_search();
+			DeviceAddress addr;
+			while (oneWire->search(addr, false)) {
+				int slot = find(addr);
+				if (slot >= 0 && present[slot])
+					readSensor(slot);
+				else
+					rescan = true; // new sensors alarm with their power-on TH/TL
+			}
+		}
+		commit();
+	}
+
+	void readSensor(uint8_t i) {
+		auto &d = devices[i];
+		ScratchPad scratchPad;
+		if (!readScratchPad(d.addr, scratchPad)) {
+			d.val = DEVICE_DISCONNECTED_C;
+			rescan = true;
+			return;
+		}
+		d.val = tempC(d.addr, scratchPad);
+		if (alarmBand != 0) {
+			// what the sensor holds, a power cycle put its EEPROM values back
+			alarmHigh[i] = scratchPad[HIGH_ALARM];
+			alarmLow[i] = scratchPad[LOW_ALARM];
+			setAlarm(i, d.val);
 		}
 	}
 
+	// The sensor compares the integer part of the reading with TH/TL and
+	// alarms on T >= TH or T <= TL. Written to the scratchpad only, the
+	// EEPROM is left alone.
+	void setAlarm(uint8_t i, float val) {
+		int t = floor(val);
+		int8_t high = std::min(t + alarmBand, 125);
+		int8_t low = std::max(t - alarmBand, -55);
+		if (high == alarmHigh[i] && low == alarmLow[i])
+			return;
+		auto &addr = devices[i].addr;
+		oneWire->reset();
+		oneWire->select(addr);
+		oneWire->write(WRITE_SCRATCHPAD);
+		oneWire->write(high);
+		oneWire->write(low);
+		if (addr[0] != DS18S20MODEL)
+			oneWire->write(config[i]);
+		alarmHigh[i] = high;
+		alarmLow[i] = low;
+	}
+
 	void printAddr(DeviceAddress addr) {
 		const char *digits("0123456789ABCDEF");
 		for (auto i = 0; i < 8; i++) {
@@ -75,43 +287,532 @@ public:
 		}
 	}
 
-	void publish() {
-		for (auto i = 0; i < addressCount; i++) {
-			auto &addr = devices[i].addr;
-			auto val = devices[i].val;
+	// Works on a snapshot, so it can run in another task than the measuring.
+	// Topics are built once per sensor, only the value is formatted here.
+	// force publishes unchanged values too, e.g. after a reconnect.
+	void publish(bool force = false) {
+		auto snap = snapshot();
+		for (auto i = 0; i < snap.count; i++) {
+			auto &addr = snap.devices[i].addr;
+			auto val = snap.devices[i].val;
+			if (addr[0] == 0)
+				continue;
 #ifdef DEBUG
 			printAddr(addr);
 			Serial.print("=");
 			Serial.print(val);
 			Serial.println("ºC");
 #endif
+			if (!std::equal(addr, addr + 8, published[i].addr))
+				setTopic(i, addr);
 			if (val == 85.0 || val < -120.0)
 				continue;
-			char buf[topicLen + 32];
-			sprintf(buf, "%s%02x%02x%02x%02x%02x%02x%02x%02x", topic, addr[0],
-					addr[1], addr[2], addr[3], addr[4], addr[5], addr[6],
-					addr[7]);
-			char msg[16];
-			snprintf(msg, sizeof(msg), "%.1f", val);
+			if (!published[i].report.due(val, force))
+				continue;
+			uint8_t msg[8];
+			unsigned int len;
+			if (encoding == CBOR)
+				len = cbor::encodeFloat(msg, val);
+			else {
+				formatTenths((char*) msg, val);
+				len = strlen((char*) msg);
+			}
+
+			bool ok = scheduler != nullptr ? scheduler->post(published[i].topic, msg, len, PRIORITY_TELEMETRY)
+					: client->publish(published[i].topic, msg, len);
+			if (ok)
+				published[i].report.sent(val);
+		}
+	}
+
+	// Same as "%.1f" for the -55..125 °C range of the sensors.
+	static void formatTenths(char *msg, float val) {
+		long v = lrint(val * 10);
+		if (v < 0) {
+			*msg++ = '-';
+			v = -v;
+		}
+		char digits[6];
+		uint8_t n = 0;
+		do {
+			digits[n++] = '0' + v % 10;
+			v /= 10;
+		} while (v > 0 || n < 2);
+		while (n > 1)
+			*msg++ = digits[--n];
+		*msg++ = '.';
+		*msg++ = digits[0];
+		*msg = 0;
+	}
+
+	// Reads the scratchpad of every sensor marked present, false if one
+	// fails the CRC. Writes the wanted resolution where it differs
+	// (scratchpad and EEPROM, so only once per sensor) and picks up the
+	// slowest one for the conversion time.
+	bool verify() {
+		bool ok = true;
+		uint8_t bits = 9;
+		presentCount = 0;
+		for (auto i = 0; i < slotCount; i++) {
+			if (!present[i])
+				continue;
+			auto &addr = devices[i].addr;
+			ScratchPad scratchPad;
+			if (!readScratchPad(addr, scratchPad)) {
+				present[i] = false;
+				devices[i].val = DEVICE_DISCONNECTED_C;
+				ok = false;
+				continue;
+			}
+			presentCount++;
+			uint8_t b = 12;
+			if (addr[0] != DS18S20MODEL) {
+				b = 9 + ((scratchPad[CONFIG_REGISTER] >> 5) & 3);
+				uint8_t wanted = wantedResolution(addr);
+				if (wanted != 0 && wanted != b) {
+					b = wanted;
+					scratchPad[CONFIG_REGISTER] = ((b - 9) << 5) | 0x1f;
+					writeScratchPad(addr, scratchPad);
+				}
+				config[i] = ((b - 9) << 5) | 0x1f;
+			}
+			alarmHigh[i] = scratchPad[HIGH_ALARM];
+			alarmLow[i] = scratchPad[LOW_ALARM];
+			bits = std::max(bits, b);
+		}
+		resolution = bits;
+		return ok && presentCount > 0;
+	}
+
+	// DS18x20 function commands, what DallasTemperature did for us before,
+	// over any Bus
+
+	bool readPowerSupply() {
+		if (oneWire->reset() == 0)
+			return false;
+		oneWire->skip();
+		oneWire->write(READ_POWER_SUPPLY);
+		bool ret = oneWire->read_bit() == 0;
+		oneWire->reset();
+		return ret;
+	}
+
+	// false when the sensor doesn't answer or the CRC is wrong
+	bool readScratchPad(const DeviceAddress addr, ScratchPad scratchPad) {
+		if (oneWire->reset() == 0)
+			return false;
+		oneWire->select(addr);
+		oneWire->write(READ_SCRATCHPAD);
+		bool zeros = true;
+		for (auto i = 0; i < 9; i++) {
+			scratchPad[i] = oneWire->read();
+			zeros &= scratchPad[i] == 0;
+		}
+		oneWire->reset();
+		return !zeros && OneWire::crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC];
+	}
+
+	// TH, TL and configuration, copied to the EEPROM too
+	void writeScratchPad(const DeviceAddress addr, const ScratchPad scratchPad) {
+		oneWire->reset();
+		oneWire->select(addr);
+		oneWire->write(WRITE_SCRATCHPAD);
+		oneWire->write(scratchPad[HIGH_ALARM]);
+		oneWire->write(scratchPad[LOW_ALARM]);
+		if (addr[0] != DS18S20MODEL)
+			oneWire->write(scratchPad[CONFIG_REGISTER]);
+		oneWire->reset();
+		oneWire->select(addr);
+		oneWire->write(COPY_SCRATCHPAD, parasite);
+		delay(20);
+		oneWire->reset();
+	}
+
+	static float tempC(const DeviceAddress addr, const ScratchPad scratchPad) {
+		// 1/128 °C
+		int16_t raw = int16_t(scratchPad[TEMP_MSB] << 11 | scratchPad[TEMP_LSB] << 3);
+		if (addr[0] == DS18S20MODEL && scratchPad[COUNT_PER_C] != 0) {
+			raw = ((raw & 0xfff0) << 3) - 32
+					+ ((scratchPad[COUNT_PER_C] - scratchPad[COUNT_REMAIN]) << 7)
+							/ scratchPad[COUNT_PER_C];
+		}
+		return raw * 0.0078125f;
+	}
+
+	static bool validFamily(const DeviceAddress addr) {
+		switch (addr[0]) {
+		case DS18S20MODEL:
+		case DS18B20MODEL:
+		case DS1822MODEL:
+		case DS1825MODEL:
+		case DS28EA00MODEL:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static uint16_t conversionMillis(uint8_t bits) {
+		switch (bits) {
+		case 9:
+			return 94;
+		case 10:
+			return 188;
+		case 11:
+			return 375;
+		default:
+			return 750;
+		}
+	}
+
+	uint8_t wantedResolution(const DeviceAddress addr) const {
+		for (auto i = 0; i < settingCount; i++) {
+			if (std::equal(addr, addr + 8, settings[i].addr))
+				return settings[i].bits;
+		}
+		return busResolution;
+	}
+
+	static uint8_t validResolution(uint8_t bits) {
+		return bits == 0 ? 0 : std::min<uint8_t>(std::max<uint8_t>(bits, 9), 12);
+	}
+
+	// loaded sensors count as present until verify() says otherwise
+	void load() {
+#ifndef ESP8266
+		Preferences prefs;
+		if (!prefs.begin("gemha", true))
+			return;
+		DeviceAddress addrs[N];
+		size_t len = prefs.getBytesLength(key);
+		if (len <= sizeof(addrs))
+			len = prefs.getBytes(key, addrs, sizeof(addrs));
+		else
+			len = 0;
+		prefs.end();
+
+		clear();
+		uint8_t count = len / sizeof(DeviceAddress);
+		for (auto i = 0; i < count; i++) {
+			if (addrs[i][0] == 0)
+				continue;
+			setAddress(i, addrs[i]);
+			present[i] = true;
+		}
+#endif
+	}
+
+	// written only when a slot changed, keeps flash wear low
+	void save() {
+#ifndef ESP8266
+		Preferences prefs;
+		if (!prefs.begin("gemha", false))
+			return;
+		DeviceAddress addrs[N];
+		for (auto i = 0; i < slotCount; i++) {
+			std::copy(devices[i].addr, devices[i].addr + 8, addrs[i]);
+		}
+		prefs.putBytes(key, addrs, slotCount * sizeof(DeviceAddress));
+		prefs.end();
+#endif
+	}
 
-			client->publish(buf, msg);
+	void clear() {
+		for (auto &d : devices) {
+			std::fill(d.addr, d.addr + 8, 0);
+			d.val = DEVICE_DISCONNECTED_C;
 		}
+		for (auto &p : present)
+			p = false;
+		std::fill(index, index + HASH_SIZE, 0);
+		slotCount = 0;
+		presentCount = 0;
+	}
+
+	// First free slot, else the first one whose sensor is gone.
+	int assign(const DeviceAddress addr) {
+		int slot = -1;
+		for (auto i = 0; i < N && slot < 0; i++) {
+			if (devices[i].addr[0] == 0)
+				slot = i;
+		}
+		for (auto i = 0; i < N && slot < 0; i++) {
+			if (!present[i])
+				slot = i;
+		}
+		if (slot < 0)
+			return -1;
+
+		bool evict = devices[slot].addr[0] != 0;
+		setAddress(slot, addr);
+		if (evict) {
+			std::fill(index, index + HASH_SIZE, 0);
+			for (auto i = 0; i < slotCount; i++) {
+				if (devices[i].addr[0] != 0)
+					insert(i);
+			}
+		}
+		return slot;
+	}
+
+	void setAddress(uint8_t i, const DeviceAddress addr) {
+		bool used = devices[i].addr[0] != 0;
+		std::copy(addr, addr + 8, devices[i].addr);
+		devices[i].val = DEVICE_DISCONNECTED_C;
+		slotCount = std::max<uint8_t>(slotCount, i + 1);
+		if (!used)
+			insert(i);
+	}
+
+	// open addressing, linear probing; index holds slot + 1, 0 is empty
+	void insert(uint8_t slot) {
+		uint16_t h = hash(devices[slot].addr);
+		while (index[h] != 0)
+			h = (h + 1) & (HASH_SIZE - 1);
+		index[h] = slot + 1;
+	}
+
+	// serial number bytes and the CRC spread well enough
+	static uint16_t hash(const DeviceAddress addr) {
+		return ((addr[1] * 31u + addr[2]) * 31u + addr[7]) & (HASH_SIZE - 1);
+	}
+
+	// topic prefix followed by the ROM in lower case hex
+	void setTopic(uint8_t i, const DeviceAddress addr) {
+		const char *digits("0123456789abcdef");
+		auto &d = published[i];
+		std::copy(addr, addr + 8, d.addr);
+		d.report.reset();
+		char *p = std::copy(topic, topic + topicLen, d.topic);
+		for (auto b = 0; b < 8; b++) {
+			*p++ = digits[addr[b] >> 4];
+			*p++ = digits[addr[b] & 15];
+		}
+		*p = 0;
+	}
+
+	void commit() {
+		Snapshot snap;
+		snap.count = slotCount;
+		std::copy(devices, devices + slotCount, snap.devices);
+		readings.store(snap);
 	}
 
+	static const uint8_t CONVERT_T = 0x44;
+	static const uint8_t COPY_SCRATCHPAD = 0x48;
+	static const uint8_t WRITE_SCRATCHPAD = 0x4e;
+	static const uint8_t READ_POWER_SUPPLY = 0xb4;
+	static const uint8_t READ_SCRATCHPAD = 0xbe;
+	static const uint8_t TEMP_LSB = 0;
+	static const uint8_t TEMP_MSB = 1;
+	static const uint8_t HIGH_ALARM = 2;
+	static const uint8_t LOW_ALARM = 3;
+	static const uint8_t CONFIG_REGISTER = 4;
+	static const uint8_t COUNT_REMAIN = 6;
+	static const uint8_t COUNT_PER_C = 7;
+	static const uint8_t SCRATCHPAD_CRC = 8;
+
+	// at most half full, keeps probe sequences short
+	static constexpr uint16_t hashSize(uint16_t n, uint16_t size = 1) {
+		return size >= n ? size : hashSize(n, size * 2);
+	}
+	static const uint16_t HASH_SIZE = hashSize(2 * N);
+
 	const char *topic;
 	uint8_t topicLen;
 
-	OneWire *oneWire;
-	DallasTemperature sensors;
+	Bus *oneWire;
 	PubSubClient *client;
+	const char *key;
 
-	static const uint8_t ADDRESS_MAX = 8;
-	volatile uint8_t addressCount = 0;
-	struct Device {
+	bool parasite = false;
+	uint8_t resolution = 12;
+	volatile bool rescan = false;
+
+	unsigned long conversionStart = 0;
+	uint16_t conversionTime = 0;
+
+	uint8_t alarmBand = 0;
+	bool alarmArmed = false;
+	uint32_t fullReadInterval = 60000;
+	unsigned long fullReadAt = 0;
+
+	// owned by the measuring task
+	uint8_t slotCount = 0;
+	uint8_t presentCount = 0;
+	Device devices[N];
+	bool present[N];
+	uint8_t index[HASH_SIZE];
+	int8_t alarmHigh[N];
+	int8_t alarmLow[N];
+	uint8_t config[N];
+	SeqLock<Snapshot> readings;
+
+	// owned by the publishing task
+	static const uint8_t TOPIC_MAX = 64;
+	struct Published {
+		DeviceAddress addr;
+		char topic[TOPIC_MAX];
+		Report<float> report { 0.2f, 300000 };
+	};
+	Published published[N];
+	Encoding encoding = TEXT;
+	Scheduler *scheduler = nullptr;
+
+	uint8_t busResolution = 0;
+	uint8_t settingCount = 0;
+	struct Setting {
 		DeviceAddress addr;
-		float val;
+		uint8_t bits;
+	};
+	Setting settings[N];
+};
+
+typedef BasicTemperature<8> Temperature;
+
+// Several 1-Wire buses (one Temperature each, with its own NVS key) run as
+// one: the convert command goes out on every bus before waiting, so a cycle
+// takes one conversion time however many buses there are. Bus b owns the
+// slots from b * T::ADDRESS_MAX on, so indices stay stable here too.
+template<uint8_t N, typename T = Temperature>
+class TemperatureBuses {
+	static_assert(N * T::ADDRESS_MAX < 256, "too many slots");
+public:
+	typedef typename T::Device Device;
+	struct Snapshot {
+		uint8_t count;
+		Device devices[N * T::ADDRESS_MAX];
 	};
-	Device devices[ADDRESS_MAX];
+
+	TemperatureBuses(std::initializer_list<T*> list) {
+		for (auto t : list) {
+			if (count == N)
+				break;
+			buses[count++] = t;
+		}
+	}
+
+	void setResolution(uint8_t bits) {
+		for (auto i = 0; i < count; i++)
+			buses[i]->setResolution(bits);
+	}
+
+	void setReport(float deadband, uint32_t maxSilence) {
+		for (auto i = 0; i < count; i++)
+			buses[i]->setReport(deadband, maxSilence);
+	}
+
+	void setAlarmBand(uint8_t degrees, uint32_t fullRead = 60000) {
+		for (auto i = 0; i < count; i++)
+			buses[i]->setAlarmBand(degrees, fullRead);
+	}
+
+	void setEncoding(Encoding encoding) {
+		for (auto i = 0; i < count; i++)
+			buses[i]->setEncoding(encoding);
+	}
+
+	void setScheduler(Scheduler *scheduler) {
+		for (auto i = 0; i < count; i++)
+			buses[i]->setScheduler(scheduler);
+	}
+
+	void start() {
+		for (auto i = 0; i < count; i++)
+			buses[i]->start();
+	}
+
+	void readAll() {
+		search();
+		startMeasure();
+		read();
+	}
+
+	bool searchNeeded() const {
+		for (auto i = 0; i < count; i++) {
+			if (buses[i]->searchNeeded())
+				return true;
+		}
+		return false;
+	}
+
+	void requestSearch() {
+		for (auto i = 0; i < count; i++)
+			buses[i]->requestSearch();
+	}
+
+	// searches only the buses which need it
+	void search() {
+		for (auto i = 0; i < count; i++) {
+			if (buses[i]->searchNeeded())
+				buses[i]->search();
+		}
+	}
+
+	void startMeasure() {
+		startConversion();
+		while (!ready())
+			delay(10);
+	}
+
+	void startConversion() {
+		for (auto i = 0; i < count; i++)
+			buses[i]->startConversion();
+	}
+
+	bool ready() {
+		for (auto i = 0; i < count; i++) {
+			if (!buses[i]->ready())
+				return false;
+		}
+		return true;
+	}
+
+	void read() {
+		for (auto i = 0; i < count; i++)
+			buses[i]->read();
+	}
+
+	// each bus is consistent in itself
+	Snapshot snapshot() const {
+		Snapshot snap;
+		snap.count = 0;
+		for (auto i = 0; i < count; i++) {
+			auto s = buses[i]->snapshot();
+			if (s.count == 0)
+				continue;
+			Device *d = snap.devices + i * T::ADDRESS_MAX;
+			for (auto gap = snap.devices + snap.count; gap < d; gap++) {
+				std::fill(gap->addr, gap->addr + 8, 0);
+				gap->val = DEVICE_DISCONNECTED_C;
+			}
+			std::copy(s.devices, s.devices + s.count, d);
+			snap.count = i * T::ADDRESS_MAX + s.count;
+		}
+		return snap;
+	}
+
+	void publish(bool force = false) {
+		for (auto i = 0; i < count; i++)
+			buses[i]->publish(force);
+	}
+
+	uint32_t suppressedCount() const {
+		uint32_t n = 0;
+		for (auto i = 0; i < count; i++)
+			n += buses[i]->suppressedCount();
+		return n;
+	}
+
+	void log(Print& p) {
+		p.print(" Temperatures: ");
+		p.print(snapshot().count);
+		p.print(" suppressed: ");
+		p.print(suppressedCount());
+	}
+
+	T *buses[N];
+	uint8_t count = 0;
 };
 
 } // namespace gemha
@@ -10,17 +10,332 @@
 
 #include <ArduinoOTA.h>
 #include <PubSubClient.h>
+#include <lwip/dhcp.h>
+#include <lwip/dns.h>
+#ifdef ESP8266
+#include <lwip/netif.h>
+#else
+#include <Preferences.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
 #include <esp_task_wdt.h>
+#endif
+
+#include <atomic>
+#include <initializer_list>
 
 #include "../config/gemconfig.h"
 
 namespace gemha {
 
-void initWiFi(const char* hostname) {
+// Where the last full join ended up: access point, channel, DHCP lease and
+// broker address. With it the next boot associates without a scan and
+// skips DNS, and DHCP too while the lease runs (LeaseClock). Kept in NVS
+// on the ESP32 and in RTC memory on the ESP8266, which survives a reset but
+// not a power cut.
+struct WiFiCache {
+	uint32_t magic;
+	uint8_t bssid[6];
+	int32_t channel;
+	uint32_t ip;
+	uint32_t gateway;
+	uint32_t subnet;
+	uint32_t dns;
+	uint32_t broker;
+
+	static const uint32_t MAGIC = 0x67656d31;
+
+	bool valid() const {
+		return magic == MAGIC && ip != 0;
+	}
+};
+
+// Seconds until the lease the board holds is due for renewal (T1). Kept in
+// RTC memory on both, which survives a reset but not a power cut: after
+// one the lease is not known to run, the cached address is not reused.
+struct LeaseClock {
+	uint32_t magic;
+	uint32_t left;
+
+	static const uint32_t MAGIC = 0x67656d6c;
+};
+
+// What the last boot took, reported with reportBoot().
+struct BootTiming {
+	unsigned long wifi;  // ms from boot to associated
+	unsigned long mqtt;  // ms from boot to the first publish
+	bool fast;           // joined from the cache
+};
+
+WiFiCache wifiCache;
+BootTiming bootTiming;
+#ifdef ESP8266
+LeaseClock leaseClock;
+// in blocks of 4 bytes, the core keeps its OTA command in the first 128
+static const uint32_t RTC_WIFI = 32;
+static const uint32_t RTC_LEASE = RTC_WIFI + (sizeof(WiFiCache) + 3) / 4;
+#else
+RTC_NOINIT_ATTR LeaseClock leaseClock;
+#endif
+// the address is the cached one, set statically
+bool leaseStatic = false;
+// ms, when keepLease() last counted
+unsigned long leaseTick = 0;
+// the lease is reused only with this much left, s
+static const uint32_t LEASE_MARGIN = 300;
+
+bool loadWiFiCache() {
+#ifdef ESP8266
+	if (!ESP.rtcUserMemoryRead(RTC_WIFI, (uint32_t*) &wifiCache, sizeof(wifiCache)))
+		return false;
+#else
+	Preferences prefs;
+	if (!prefs.begin("gemha", true))
+		return false;
+	prefs.getBytes("wifi", &wifiCache, sizeof(wifiCache));
+	prefs.end();
+#endif
+	return wifiCache.valid();
+}
+
+// written only when something changed
+void saveWiFiCache(const WiFiCache &c) {
+	if (memcmp(&c, &wifiCache, sizeof(c)) == 0)
+		return;
+	wifiCache = c;
+#ifdef ESP8266
+	ESP.rtcUserMemoryWrite(RTC_WIFI, (uint32_t*) &wifiCache, sizeof(wifiCache));
+#else
+	Preferences prefs;
+	if (!prefs.begin("gemha", false))
+		return;
+	prefs.putBytes("wifi", &wifiCache, sizeof(wifiCache));
+	prefs.end();
+#endif
+}
+
+bool loadLease() {
+#ifdef ESP8266
+	if (!ESP.rtcUserMemoryRead(RTC_LEASE, (uint32_t*) &leaseClock, sizeof(leaseClock)))
+		return false;
+#endif
+	return leaseClock.magic == LeaseClock::MAGIC;
+}
+
+void saveLease(uint32_t left) {
+	leaseClock.magic = LeaseClock::MAGIC;
+	leaseClock.left = left;
+#ifdef ESP8266
+	ESP.rtcUserMemoryWrite(RTC_LEASE, (uint32_t*) &leaseClock, sizeof(leaseClock));
+#endif
+}
+
+struct netif* staNetif() {
+#ifdef ESP8266
+	return netif_default;
+#else
+	esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+	return netif != nullptr ? (struct netif*) esp_netif_get_netif_impl(netif) : nullptr;
+#endif
+}
+
+// Time to T1 of the lease lwIP holds, false when DHCP didn't supply the
+// address. lwIP counts in minutes.
+bool dhcpLeaseLeft(uint32_t &left) {
+	struct netif *netif = staNetif();
+	if (netif == nullptr || !dhcp_supplied_address(netif))
+		return false;
+	struct dhcp *dhcp = netif_dhcp_data(netif);
+	left = dhcp->t1_timeout > dhcp->lease_used ?
+			(uint32_t) (dhcp->t1_timeout - dhcp->lease_used) * DHCP_COARSE_TIMER_SECS : 0;
+	return true;
+}
+
+// Call from loop(). While the address is the cached one, counts the lease
+// down and hands it to DHCP when it's due for renewal, the connections
+// drop with that. Once DHCP holds it, lwIP renews and the clock follows.
+void keepLease() {
+	uint32_t elapsed = (millis() - leaseTick) / 1000;
+	if (elapsed < 10)
+		return;
+	leaseTick += elapsed * 1000;
+	uint32_t left = leaseClock.left > elapsed ? leaseClock.left - elapsed : 0;
+	if (!leaseStatic) {
+		dhcpLeaseLeft(left);
+	} else if (left == 0) {
+		WiFi.config(IPAddress((uint32_t) 0), IPAddress((uint32_t) 0), IPAddress((uint32_t) 0));
+		leaseStatic = false;
+	}
+	saveLease(left);
+}
+
+bool waitForWiFi(unsigned long timeout) {
+	unsigned long start = millis();
+	while (WiFi.status() != WL_CONNECTED) {
+		if (millis() - start > timeout)
+			return false;
+		delay(10);
+	}
+	return true;
+}
+
+// Direct rejoin from the cache, with the cached address while its lease
+// runs and DHCP otherwise; a full scan with DHCP if that fails.
+bool joinWiFi(const char* hostname) {
 	WiFi.mode(WIFI_STA);
-	WiFi.begin(ssid, passwd);
+#ifdef ESP8266
+	WiFi.hostname(hostname);
+#else
 	WiFi.setHostname(hostname);
-	while (WiFi.waitForConnectResult() != WL_CONNECTED) {
+#endif
+	bootTiming.fast = false;
+	leaseStatic = false;
+	if (loadWiFiCache()) {
+		leaseStatic = loadLease() && leaseClock.left > LEASE_MARGIN;
+		if (leaseStatic)
+			WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+					IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+		WiFi.begin(ssid, passwd, wifiCache.channel, wifiCache.bssid);
+		bootTiming.fast = waitForWiFi(leaseStatic ? 3000 : 5000);
+		if (!bootTiming.fast) {
+			WiFi.disconnect();
+			// back to DHCP
+			if (leaseStatic)
+				WiFi.config(IPAddress((uint32_t) 0), IPAddress((uint32_t) 0), IPAddress((uint32_t) 0));
+			leaseStatic = false;
+		}
+	}
+	if (!bootTiming.fast) {
+		WiFi.begin(ssid, passwd);
+		if (!waitForWiFi(20000))
+			return false;
+	}
+	bootTiming.wifi = millis();
+	if (!leaseStatic) {
+		uint32_t left = 0;
+		dhcpLeaseLeft(left);
+		saveLease(left);
+	}
+	// UTC, for timestamps of samples queued while offline
+	configTime(0, 0, "pool.ntp.org");
+#ifdef DEBUG
+	Serial.print(bootTiming.fast ? "WiFi rejoined in " : "WiFi joined in ");
+	Serial.print(bootTiming.wifi);
+	Serial.println(" ms");
+#endif
+
+	WiFiCache c = wifiCache;
+	c.magic = WiFiCache::MAGIC;
+	memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+	c.channel = WiFi.channel();
+	c.ip = WiFi.localIP();
+	c.gateway = WiFi.gatewayIP();
+	c.subnet = WiFi.subnetMask();
+	c.dns = WiFi.dnsIP();
+	if (!bootTiming.fast)
+		c.broker = 0; // resolved again, it may have moved with the network
+	saveWiFiCache(c);
+	return true;
+}
+
+// Looks the broker up without blocking the caller: lwIP answers from its
+// cache right away or calls back from its own task once the server replied
+// or it gave up, about 14 s later. One lookup at a time.
+class BrokerLookup {
+public:
+	// false while the last one is still running
+	bool start() {
+		uint8_t idle = IDLE;
+		if (!state.compare_exchange_strong(idle, PENDING))
+			return false;
+		ip_addr_t addr;
+		err_t err = dns_gethostbyname(server, &addr, found, this);
+		if (err == ERR_OK)
+			found(server, &addr, this);
+		else if (err != ERR_INPROGRESS)
+			state.store(IDLE);
+		return true;
+	}
+
+	// true once per answer
+	bool poll(IPAddress &ip) {
+		if (state.load(std::memory_order_acquire) != DONE)
+			return false;
+		ip = IPAddress(result);
+		state.store(IDLE);
+		return true;
+	}
+
+	bool pending() const {
+		return state.load() == PENDING;
+	}
+private:
+	static void found(const char*, const ip_addr_t *addr, void *arg) {
+		BrokerLookup *self = (BrokerLookup*) arg;
+		if (addr == nullptr || !IP_IS_V4(addr)) {
+			self->state.store(IDLE);
+			return;
+		}
+		self->result = ip4_addr_get_u32(ip_2_ip4(addr));
+		self->state.store(DONE, std::memory_order_release);
+	}
+
+	enum : uint8_t {
+		IDLE, PENDING, DONE
+	};
+	std::atomic<uint8_t> state { IDLE };
+	uint32_t result = 0;
+};
+
+BrokerLookup brokerLookup;
+
+// Takes a looked up address, kept in the cache for the next boot.
+void useBroker(PubSubClient& client, IPAddress ip) {
+	WiFiCache c = wifiCache;
+	c.broker = ip;
+	saveWiFiCache(c);
+	client.setServer(ip, 1883);
+}
+
+// Points the client at the broker without a DNS lookup per connect. The
+// address comes from the cache, or from a lookup bounded to 3 s when there
+// is none; failing that the client keeps the name.
+void setBroker(PubSubClient& client) {
+	if (wifiCache.broker != 0) {
+		client.setServer(IPAddress(wifiCache.broker), 1883);
+		return;
+	}
+	client.setServer(server, 1883);
+	brokerLookup.start();
+	unsigned long start = millis();
+	IPAddress ip;
+	while (brokerLookup.pending() && millis() - start < 3000)
+		delay(10);
+	if (brokerLookup.poll(ip))
+		useBroker(client, ip);
+}
+
+// Publishes once per boot how long it took to get online.
+void reportBoot(PubSubClient& client, const char* hostname) {
+	if (bootTiming.mqtt != 0)
+		return;
+	bootTiming.mqtt = millis();
+	char topic[64];
+	snprintf(topic, sizeof(topic), "house/boot/%s", hostname);
+	char msg[48];
+	snprintf(msg, sizeof(msg), "wifi=%lu mqtt=%lu fast=%d",
+			bootTiming.wifi, bootTiming.mqtt, bootTiming.fast);
+#ifdef DEBUG
+	Serial.print(topic);
+	Serial.print(" ");
+	Serial.println(msg);
+#endif
+	if (!client.publish(topic, msg))
+		bootTiming.mqtt = 0;
+}
+
+void initWiFi(const char* hostname) {
+	if (!joinWiFi(hostname)) {
 #ifdef DEBUG
 		Serial.println("Connection Failed! Rebooting...");
 #endif
@@ -33,31 +348,226 @@ void initWiFi(const char* hostname) {
 #endif
 	randomSeed(micros());
 
+#ifndef ESP8266
 	ArduinoOTA.onProgress([] (int, int) {esp_task_wdt_reset();});
+#endif
 	ArduinoOTA.setPassword(otaPassword);
 	ArduinoOTA.setHostname(hostname);
 	ArduinoOTA.begin();
 
+#ifndef ESP8266
 	esp_task_wdt_init(5, true);
 	esp_task_wdt_add(NULL);
+#endif
 }
 
-bool connectMqtt(PubSubClient& client, const char* hostname, const char* topic = nullptr) {
+// Same on every boot, the broker keys the session on it. The end of the
+// MAC is added as two boards may share a hostname.
+String mqttClientId(const char* hostname) {
+	uint8_t mac[6];
+	WiFi.macAddress(mac);
+	char id[48];
+	snprintf(id, sizeof(id), "%s-%02x%02x%02x", hostname, mac[3], mac[4], mac[5]);
+	return id;
+}
+
+// Persistent session (cleanSession false): the broker keeps the
+// subscriptions and queues QoS 1 commands while the board is away, they
+// arrive right after the reconnect. Topics are subscribed with QoS 1.
+bool connectMqtt(PubSubClient& client, const char* hostname, std::initializer_list<const char*> topics) {
 	if (client.connected())
 		return true;
-	String clientId = hostname;
-	clientId += String(random(0xffff), HEX);
-	if (!client.connect(clientId.c_str())) {
+	if (!client.connect(mqttClientId(hostname).c_str(), nullptr, nullptr, nullptr, 0, false, nullptr, false)) {
 #ifdef DEBUG
 		Serial.print("mqtt connect failed, rc=");
 		Serial.println(client.state());
 #endif
 		return false;
 	}
-	if (topic != nullptr)
-		return client.subscribe(topic);
+	bool ret = true;
+	for (auto topic: topics) {
+		if (topic != nullptr)
+			ret &= client.subscribe(topic, 1);
+	}
+	return ret;
+}
 
-	return true;
+bool connectMqtt(PubSubClient& client, const char* hostname, const char* topic = nullptr) {
+	return connectMqtt(client, hostname, {topic});
 }
 
+// Keeps the MQTT session up without stalling loop(). PubSubClient connects
+// synchronously, so an attempt is bounded and made only once the backoff
+// expired: a dead broker costs one attempt per backoff period instead of
+// one per loop(). Over an AsyncClient an attempt blocks at most its
+// CONNECT_MS for TCP plus SOCKET_TIMEOUT for the CONNACK, 3 s, well inside
+// the 5 s task watchdog. Don't raise the socket timeout in the sketch. The
+// broker is never looked up in the same pass: the lookup runs in the
+// background, started from a pass of its own, and attempts wait for it
+// only while no address is known. The backoff doubles on every failure up
+// to the maximum, with jitter so that all boards don't come back at once.
+class MqttConnection {
+public:
+	enum State {
+		WIFI_DOWN, BACKOFF, CONNECTING, CONNECTED
+	};
+	typedef void (*Callback)(State state);
+
+	MqttConnection(PubSubClient &client, const char *hostname,
+			std::initializer_list<const char*> topics = { }) :
+			client(client), hostname(hostname) {
+		for (auto topic : topics) {
+			if (topic != nullptr && topicCount < TOPICS_MAX)
+				this->topics[topicCount++] = topic;
+		}
+		client.setSocketTimeout(SOCKET_TIMEOUT);
+	}
+
+	// called on every state change, from loop()
+	void onChange(Callback callback) {
+		this->callback = callback;
+	}
+
+	void setBackoff(uint32_t minMs, uint32_t maxMs) {
+		minBackoff = minMs;
+		maxBackoff = maxMs;
+		backoff = minMs;
+	}
+
+	// Call from loop() instead of client.loop() and keepLease(), true while
+	// connected.
+	bool loop() {
+		unsigned long now = millis();
+		keepLease();
+		switch (current) {
+		case CONNECTED:
+			if (client.loop())
+				return true;
+			fail(now);
+			return false;
+		case WIFI_DOWN:
+			if (WiFi.status() != WL_CONNECTED)
+				return false;
+			backoff = minBackoff;
+			wait = 0;
+			set(BACKOFF);
+			return false;
+		case BACKOFF:
+			if (WiFi.status() != WL_CONNECTED) {
+				set(WIFI_DOWN);
+				return false;
+			}
+			if (lookupBroker())
+				return false;
+			if (now - lastAt < wait)
+				return false;
+			set(CONNECTING);
+			// no break
+		case CONNECTING:
+			if (!connect()) {
+				fail(millis());
+				return false;
+			}
+			backoff = minBackoff;
+			streak = 0;
+			set(CONNECTED);
+			reportBoot(client, hostname);
+			return true;
+		}
+		return false;
+	}
+
+	// Drops the session, e.g. after a failed publish. The next attempt
+	// waits for the backoff like after any other failure.
+	void disconnect() {
+		client.disconnect();
+		if (current == CONNECTED)
+			fail(millis());
+	}
+
+	State state() const {
+		return current;
+	}
+
+	bool connected() const {
+		return current == CONNECTED;
+	}
+
+	uint32_t failureCount() const {
+		return failures;
+	}
+private:
+	// PubSubClient doesn't tell whether the broker still had the session,
+	// so the topics are subscribed on every connect. For a session it kept
+	// that's a no-op, the queued commands arrive either way.
+	bool connect() {
+		if (!connectMqtt(client, hostname))
+			return false;
+		bool ret = true;
+		for (auto i = 0; i < topicCount; i++)
+			ret &= client.subscribe(topics[i], 1);
+		if (!ret)
+			client.disconnect();
+		return ret;
+	}
+
+	// true when the pass went to the lookup, or there's no address to try
+	bool lookupBroker() {
+		IPAddress ip;
+		if (brokerLookup.poll(ip)) {
+			useBroker(client, ip);
+			return true;
+		}
+		if ((lookupDue || wifiCache.broker == 0) && brokerLookup.start()) {
+			lookupDue = false;
+			return true;
+		}
+		return wifiCache.broker == 0;
+	}
+
+	// next attempt after backoff/2 .. backoff
+	// every third failure in a row looks the broker up again
+	void fail(unsigned long now) {
+		failures++;
+		if (++streak % 3 == 0)
+			lookupDue = true;
+		lastAt = now;
+		wait = backoff / 2 + random(backoff / 2 + 1);
+		backoff = std::min(backoff * 2, maxBackoff);
+		set(WiFi.status() == WL_CONNECTED ? BACKOFF : WIFI_DOWN);
+	}
+
+	void set(State state) {
+		if (state == current)
+			return;
+		current = state;
+#ifdef DEBUG
+		static const char *names[] = { "wifi down", "backoff", "connecting", "connected" };
+		Serial.print("mqtt: ");
+		Serial.println(names[state]);
+#endif
+		if (callback != nullptr)
+			callback(state);
+	}
+
+	static const uint8_t TOPICS_MAX = 4;
+	static const uint16_t SOCKET_TIMEOUT = 2; // s, PubSubClient default is 15
+
+	PubSubClient &client;
+	const char *hostname;
+	const char *topics[TOPICS_MAX];
+	uint8_t topicCount = 0;
+	Callback callback = nullptr;
+
+	State current = WIFI_DOWN;
+	uint32_t minBackoff = 1000;
+	uint32_t maxBackoff = 60000;
+	uint32_t backoff = 1000;
+	uint32_t wait = 0;
+	unsigned long lastAt = 0;
+	uint32_t failures = 0;
+	uint8_t streak = 0;
+	bool lookupDue = false;
+};
+
 } // namespace gemha
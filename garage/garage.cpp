@@ -3,10 +3,17 @@
 #include <ArduinoOTA.h>
 #include <PubSubClient.h>
 #include <EEPROM.h>
-#include <esp_task_wdt.h>
 #include <PZEM004Tv30.h>
 
+#include "../common/async_client.h"
+#include "../common/batch.h"
 #include "../common/button.h"
+#include "../common/outbox.h"
+#include "../common/router.h"
+#include "../common/ring.h"
+#include "../common/runtime.h"
+#include "../common/scheduler.h"
+#include "../common/seqlock.h"
 #include "../common/wifi.h"
 
 #include "../config/gemconfig.h"
@@ -25,33 +32,38 @@ const char *otaHostname = "garage.gem";
 #define TOPIC_INPUT "input/"
 #define TOPIC_RELAY "relay/"
 #define TOPIC_PZEM "power/"
+#define TOPIC_CPU "cpu"
 
 const unsigned long PERIOD = 30000;
 const unsigned long PERIOD_PZEM = 5000;
+const unsigned long PERIOD_CPU = 60000;
+
+// power/<n>/<value> per reading, power/<n> as one JSON object per PZEM, or both
+const gemha::PublishMode PZEM_MODE = gemha::PER_VALUE;
+// TEXT, or CBOR to skip float formatting and shrink the payloads
+const gemha::Encoding PZEM_ENCODING = gemha::TEXT;
 
 volatile bool isOnline = false;
 
-TaskHandle_t inputTask;
-TaskHandle_t loggerTask;
+gemha::SpscRing<gemha::InputEvent, 32> events;
 
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+gemha::MqttConnection mqtt(client, otaHostname, { TOPIC_PREFIX TOPIC_RELAY "#" });
+gemha::Scheduler outgoing;
+
+// PZEM readings taken while offline, every PERIOD, about 80 min of them
+gemha::Outbox<16, 8192> outbox;
 
 PZEM004Tv30 pzems[] ={ {Serial2, 16, 17, 1}, {Serial2, 16, 17, 2}, {Serial2, 16, 17, 3}};
+static const int PZEMS = sizeof(pzems) / sizeof(pzems[0]);
 
-int getValue(const byte *payload, unsigned int length) {
-	char buf[8];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return -1;
-
-	memcpy(buf, payload, length);
-	char *dummy;
-	int value = strtoul(buf, &dummy, 10);
-	if (dummy == buf)
-		return -1;
-	return value;
-}
+// the last poll, NaN for a failed read
+struct PzemReadings {
+	float vals[PZEMS][6];
+};
+gemha::SeqLock<PzemReadings> pzemReadings;
 
 void processRelay(int channel, int value) {
 	if (channel < 0 || channel > RELAYS - 1)
@@ -70,6 +82,15 @@ void processRelay(int channel, int value) {
 	EEPROM.commit();
 }
 
+void onRelay(const gemha::TopicMatch &m) {
+	processRelay(m.arg[0], m.value());
+}
+
+constexpr gemha::TopicRoute routes[] = {
+	{ TOPIC_PREFIX TOPIC_RELAY "+", onRelay },
+};
+constexpr auto router = gemha::topicRouter(routes);
+
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 #ifdef DEBUG
 	Serial.print("Message arrived [");
@@ -81,20 +102,7 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	Serial.println();
 #endif
 
-	if (strncmp(topic, TOPIC_PREFIX TOPIC_RELAY, sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1) != 0)
-		return;
-	topic += sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1;
-
-	char *dummy;
-	int channel = strtoul(topic, &dummy, 10);
-	if (dummy == topic)
-		return;
-
-	int value = getValue(payload, length);
-	if (value == -1)
-		return;
-
-	processRelay(channel, value);
+	router.dispatch(topic, payload, length);
 }
 
 void logPzem(PZEM004Tv30& pzem) {
@@ -149,14 +157,23 @@ void logger(void *p) {
 //		for (auto& pzem: pzems) {
 //			logPzem(pzem);
 //		}
-		delay(1000);
+		gemha::taskDelay(1000);
 	}
 }
 
 void readInputs(void *p) {
+	bool last[INPUTS];
+	for (auto i = 0; i < INPUTS; i++) {
+		inputs[i].attach(xTaskGetCurrentTaskHandle());
+		last[i] = inputs[i];
+	}
 	for (;;) {
-		for (auto i = 0; i < INPUTS; i++) {
-			inputs[i].check();
+		for (uint8_t i = 0; i < INPUTS; i++) {
+			bool v = inputs[i];
+			if (v != last[i]) {
+				last[i] = v;
+				events.push({i, v, inputs[i].lastChange()});
+			}
 		}
 		if (!isOnline && millis() > 15000) {
 			for (auto i = 0; i < INPUTS; i++) {
@@ -167,10 +184,35 @@ void readInputs(void *p) {
 			}
 		}
 
-		delay(5);
+		// woken by input changes, timeout catches online/offline switches
+		gemha::taskWait([] { return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)); });
 	}
 }
 
+// Modbus reads take a while, they are polled here, off the network task
+void readPzems(void *p) {
+	for (;;) {
+		PzemReadings r;
+		for (auto i = 0; i < PZEMS; i++) {
+			auto &pzem = pzems[i];
+			float vals[] = { pzem.voltage(), pzem.current(), pzem.power(), pzem.energy(),
+					pzem.frequency(), pzem.pf() };
+			std::copy(vals, vals + 6, r.vals[i]);
+		}
+		pzemReadings.store(r);
+		gemha::taskDelay(PERIOD_PZEM);
+	}
+}
+
+void network(void *p);
+
+const gemha::TaskSpec tasks[] = {
+	{ "input", readInputs, 4096, 5, gemha::APP_CORE },
+	{ "pzem", readPzems, 4096, 4, gemha::APP_CORE },
+	{ "logger", logger, 4096, 1, gemha::APP_CORE },
+};
+const gemha::TaskSpec networkTask = { "net", network, 8192, 3, gemha::NET_CORE };
+
 void setup() {
 	EEPROM.begin(RELAYS);
 	int pos = 0;
@@ -181,85 +223,108 @@ void setup() {
 
 	Serial.begin(115200);
 
-	xTaskCreate(logger, "logger", 4096, nullptr, 1, &loggerTask);
-	xTaskCreate(readInputs, "input", 4096, nullptr, 1, &inputTask);
+	PzemReadings none;
+	for (auto &vals : none.vals)
+		std::fill(vals, vals + 6, NAN);
+	pzemReadings.store(none);
+	gemha::startTasks(tasks);
 
+	outbox.begin();
 	gemha::initWiFi(otaHostname);
 
 	espClient.setTimeout(1);
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
-	client.setSocketTimeout(3);
+	gemha::startTask(networkTask);
 }
 
-bool publishPzems() {
+static const char *pzemValues[] = { "voltage", "current", "power", "energy", "frequency", "pf" };
+
+bool publishPzems(bool online = true) {
 	bool ret = true;
 	char topic[sizeof(TOPIC_PREFIX TOPIC_PZEM "123/frequency")];
-	char data[16];
-	for (int i = 0; i < sizeof(pzems) / sizeof(pzems[0]); i++) {
-		auto& pzem = pzems[i];
-		float val;
-#define PZEM_PUBLISH(name) \
-		val = pzem.name(); \
-		if (!isnan(val)) { \
-			sprintf(topic, TOPIC_PREFIX TOPIC_PZEM "%d/" #name, i); \
-			sprintf(data, "%.3f", pzem.name()); \
-			ret &= client.publish(topic, data); \
+	uint8_t data[gemha::VALUE_MAX];
+	auto readings = pzemReadings.load();
+	for (int i = 0; i < PZEMS; i++) {
+		const float *vals = readings.vals[i];
+
+		if (online && (PZEM_MODE & gemha::BATCHED)) {
+			sprintf(topic, TOPIC_PREFIX TOPIC_PZEM "%d", i);
+			ret &= gemha::publishBatch(client, topic, [&](gemha::Batch &batch) {
+				for (auto j = 0; j < 6; j++)
+					batch.add(pzemValues[j], vals[j], 3);
+			}, PZEM_ENCODING);
+			if (!(PZEM_MODE & gemha::PER_VALUE))
+				continue;
+		}
+		// queued per value, a batch does not fit an outbox record
+		for (auto j = 0; j < 6; j++) {
+			if (isnan(vals[j]))
+				continue;
+			sprintf(topic, TOPIC_PREFIX TOPIC_PZEM "%d/%s", i, pzemValues[j]);
+			// the outbox keeps text, drained records are wrapped in JSON
+			if (!online) {
+				gemha::encodeValue(data, vals[j], 3, gemha::TEXT);
+				ret &= outbox.push(topic, (char*) data);
+				continue;
+			}
+			uint8_t len = gemha::encodeValue(data, vals[j], 3, PZEM_ENCODING);
+			ret &= outgoing.post(topic, data, len, gemha::PRIORITY_TELEMETRY);
 		}
-
-		PZEM_PUBLISH(voltage)
-		PZEM_PUBLISH(current)
-		PZEM_PUBLISH(power)
-		PZEM_PUBLISH(energy)
-		PZEM_PUBLISH(frequency)
-		PZEM_PUBLISH(pf)
 	}
 
 	return ret;
 }
 
-bool publish(bool force) {
-	static bool published[INPUTS];
-
-	bool ret = true;
+bool publishInput(int i, bool value, gemha::Priority priority) {
 	char topic[] = TOPIC_PREFIX TOPIC_INPUT "\0\0";
 	int pos = sizeof(topic) - 3;
+	if (i < 10)
+		topic[pos] = '0' + i;
+	else {
+		topic[pos] = '0' + (i / 10);
+		topic[pos + 1] = '0' + (i %10);
+	}
+	return outgoing.post(topic, value ? "0" : "1", priority);
+}
+
+bool publish(bool force) {
+	bool ret = true;
+	if (!force) {
+		// a change stays queued until the scheduler took it
+		gemha::InputEvent e;
+		while (events.peek(e)) {
+			if (!publishInput(e.input, e.value, gemha::PRIORITY_CHANGE))
+				return false;
+			events.pop(e);
+		}
+		return true;
+	}
+
+	// queued changes are covered by the full state below
+	events.clear();
 	for (int i = 0; i < INPUTS && ret; i++) {
-		if (!force && published[i] == inputs[i])
-			continue;
+		ret &= publishInput(i, inputs[i], gemha::PRIORITY_TELEMETRY);
+	}
+
+	char topic[] = TOPIC_PREFIX TOPIC_RELAY "\0\0";
+	int pos = sizeof(topic) - 3;
+	for (int i = 0; i < RELAYS && ret; i++) {
 		if (i < 10)
 			topic[pos] = '0' + i;
 		else {
 			topic[pos] = '0' + (i / 10);
 			topic[pos + 1] = '0' + (i %10);
 		}
-		ret &= client.publish(topic, inputs[i] ? "0" : "1");
-		if (ret)
-			published[i] = inputs[i];
-	}
-
-	if (force) {
-		char topic[] = TOPIC_PREFIX TOPIC_RELAY "\0\0";
-		int pos = sizeof(topic) - 3;
-		for (int i = 0; i < RELAYS && ret; i++) {
-			if (i < 10)
-				topic[pos] = '0' + i;
-			else {
-				topic[pos] = '0' + (i / 10);
-				topic[pos + 1] = '0' + (i %10);
-			}
-			ret &= client.publish(topic, digitalRead(relays[i]) ? "0" : "1");
-		}
+		ret &= outgoing.post(topic, digitalRead(relays[i]) ? "0" : "1", gemha::PRIORITY_TELEMETRY);
 	}
 	return ret;
 }
 
-void loop() {
+void loopNetwork() {
 	static bool force = true;
-	esp_task_wdt_reset();
 	ArduinoOTA.handle();
-	client.loop();
-	isOnline = gemha::connectMqtt(client, otaHostname, TOPIC_PREFIX TOPIC_RELAY "#");
+	isOnline = mqtt.loop();
 
 	if (isOnline) {
 		static unsigned long last;
@@ -269,17 +334,38 @@ void loop() {
 			last = now;
 			pereodicForce = true;
 		}
-		if (!publish(force || pereodicForce))
-			client.disconnect();
+		bool full = force || pereodicForce;
+		// a full state that didn't go out is tried again next pass
+		force = !publish(full) && full;
 
 		static unsigned long lastPzem;
 		if (now - lastPzem > PERIOD_PZEM) {
 			lastPzem = now;
-			if (!publishPzems())
-				client.disconnect();
+			publishPzems();
+		}
+		static unsigned long lastCpu;
+		if (now - lastCpu > PERIOD_CPU) {
+			lastCpu = now;
+			gemha::publishCpu(client, TOPIC_PREFIX TOPIC_CPU);
+		}
+		outgoing.run(client);
+		outbox.drain(client);
+	} else {
+		static unsigned long lastQueued;
+		unsigned long now = millis();
+		if (now - lastQueued > PERIOD) {
+			lastQueued = now;
+			publishPzems(false);
 		}
 	}
-	force = !isOnline;
+	if (!isOnline)
+		force = true;
+}
 
-	delay(1);
+void network(void *p) {
+	gemha::runNetwork(loopNetwork, 1);
+}
+
+void loop() {
+	gemha::endLoopTask();
 }
@@ -0,0 +1,128 @@
+#include "../../common/async_client.h"
+
+#include "bench.h"
+
+namespace {
+
+// A socket with a send buffer of WINDOW bytes that the link drains at
+// rate bytes per ms of simulated time.
+struct FakeNet {
+	static const size_t WINDOW = 1024;
+
+	size_t rate;
+	size_t buffered = 0;
+	unsigned long drainedAt = 0;
+	uint64_t sent = 0;
+	uint64_t blockedMs = 0;
+
+	FakeNet(size_t rate) : rate(rate) {
+	}
+
+	size_t room() {
+		unsigned long now = millis();
+		buffered -= std::min<size_t>(buffered, (now - drainedAt) * rate);
+		drainedAt = now;
+		return WINDOW - buffered;
+	}
+
+	// what WiFiClient::write does: wait until the buffer took it all
+	size_t write(const uint8_t *buf, size_t size) {
+		for (size_t done = 0; done < size;) {
+			size_t n = std::min(size - done, room());
+			if (n == 0) {
+				delay(1);
+				blockedMs++;
+				continue;
+			}
+			buffered += n;
+			sent += n;
+			done += n;
+		}
+		return size;
+	}
+
+	int connect(const char*, uint16_t) {
+		return 1;
+	}
+	int available() {
+		return 0;
+	}
+	int read() {
+		return -1;
+	}
+	int read(uint8_t*, size_t) {
+		return 0;
+	}
+	int peek() {
+		return -1;
+	}
+	void stop() {
+	}
+	uint8_t connected() {
+		return 1;
+	}
+};
+
+int sendNow(FakeNet &net, const uint8_t *buf, size_t size) {
+	size_t n = std::min(size, net.room());
+	net.buffered += n;
+	net.sent += n;
+	return n;
+}
+
+// a QoS 0 PUBLISH as PubSubClient writes it, in one piece
+size_t publishPacket(uint8_t *buf, const char *topic, const char *payload) {
+	size_t t = strlen(topic);
+	size_t p = strlen(payload);
+	buf[0] = 0x30;
+	buf[1] = 2 + t + p;
+	buf[2] = t >> 8;
+	buf[3] = t;
+	memcpy(buf + 4, topic, t);
+	memcpy(buf + 4 + t, payload, p);
+	return 4 + t + p;
+}
+
+// light's forced publish, 11 inputs and 8 relays, every 30 ms of loop()
+// over a link that takes 10 bytes/ms: a backlog builds up
+template<typename W>
+void burst(uint64_t iterations, W write) {
+	uint8_t buf[64];
+	char topic[32];
+	for (uint64_t i = 0; i < iterations; i++) {
+		for (auto j = 0; j < 19; j++) {
+			snprintf(topic, sizeof(topic), "house/light1/%s/%d", j < 11 ? "input" : "relay", j % 11);
+			write(buf, publishPacket(buf, topic, j & 1 ? "1" : "0"));
+		}
+		delay(30);
+	}
+}
+
+} // namespace
+
+// the time loop() spends in writes waiting for the socket
+BENCHMARK(publishBlocking) {
+	FakeNet net(10);
+	burst(state.iterations, [&](const uint8_t *buf, size_t size) {
+		return net.write(buf, size);
+	});
+	state.count("sentB", net.sent);
+	state.count("blockedMs", net.blockedMs);
+}
+
+// the same through AsyncClient: no waiting, packets refused instead
+BENCHMARK(publishAsync) {
+	FakeNet net(10);
+	gemha::BasicAsyncClient<FakeNet> async(net);
+	async.connect("broker", 1883);
+	uint32_t accepted = 0;
+	burst(state.iterations, [&](const uint8_t *buf, size_t size) {
+		size_t n = async.write(buf, size);
+		accepted += n == size;
+		return n;
+	});
+	state.count("sentB", net.sent);
+	state.count("blockedMs", net.blockedMs);
+	state.count("accepted", accepted);
+	state.count("refused", async.refusedCount());
+}
@@ -0,0 +1,80 @@
+#include "../../common/batch.h"
+
+#include "bench.h"
+
+namespace {
+
+const char *names[] = { "voltage", "current", "power", "energy", "frequency", "pf" };
+
+// one garage PZEM cycle, three meters
+void readings(float vals[3][6], uint64_t i) {
+	for (auto p = 0; p < 3; p++)
+		for (auto j = 0; j < 6; j++)
+			vals[p][j] = 230.0 + (i & 15) * 0.1 + p + j;
+}
+
+} // namespace
+
+BENCHMARK(pzemPerValue) {
+	PubSubClient client;
+	client.connect("bench");
+	uint32_t published = client.published;
+	uint64_t bytes = client.bytes;
+	char topic[32];
+	char data[16];
+	float vals[3][6];
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		readings(vals, i);
+		for (auto p = 0; p < 3; p++) {
+			for (auto j = 0; j < 6; j++) {
+				sprintf(topic, "house/garage/power/%d/%s", p, names[j]);
+				sprintf(data, "%.3f", vals[p][j]);
+				client.publish(topic, data);
+			}
+		}
+	}
+	state.count("msgs", client.published - published);
+	state.count("wireB", client.bytes - bytes);
+}
+
+BENCHMARK(pzemBatched) {
+	PubSubClient client;
+	client.connect("bench");
+	uint32_t published = client.published;
+	uint64_t bytes = client.bytes;
+	char topic[32];
+	float vals[3][6];
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		readings(vals, i);
+		for (auto p = 0; p < 3; p++) {
+			sprintf(topic, "house/garage/power/%d", p);
+			gemha::publishBatch(client, topic, [&](gemha::Batch &batch) {
+				for (auto j = 0; j < 6; j++)
+					batch.add(names[j], vals[p][j], 3);
+			});
+		}
+	}
+	state.count("msgs", client.published - published);
+	state.count("wireB", client.bytes - bytes);
+}
+
+BENCHMARK(pzemBatchedCbor) {
+	PubSubClient client;
+	client.connect("bench");
+	uint32_t published = client.published;
+	uint64_t bytes = client.bytes;
+	char topic[32];
+	float vals[3][6];
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		readings(vals, i);
+		for (auto p = 0; p < 3; p++) {
+			sprintf(topic, "house/garage/power/%d", p);
+			gemha::publishBatch(client, topic, [&](gemha::Batch &batch) {
+				for (auto j = 0; j < 6; j++)
+					batch.add(names[j], vals[p][j], 3);
+			}, gemha::CBOR);
+		}
+	}
+	state.count("msgs", client.published - published);
+	state.count("wireB", client.bytes - bytes);
+}
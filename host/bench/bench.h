@@ -0,0 +1,38 @@
+#pragma once
+
+// Minimal benchmark harness: each BENCHMARK body loops state.iterations
+// times; main() calibrates the count and reports ns/op and allocations/op
+// plus any counters added with state.count().
+
+#include <stdint.h>
+
+namespace bench {
+
+struct State {
+	uint64_t iterations;
+
+	void count(const char *name, uint64_t value);
+
+	static const int COUNTERS = 4;
+	const char *names[COUNTERS];
+	uint64_t values[COUNTERS];
+	int counters = 0;
+};
+
+typedef void (*Function)(State&);
+
+struct Registrar {
+	Registrar(const char *name, Function f);
+};
+
+template<class T>
+inline void doNotOptimize(T const &value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+
+#define BENCHMARK(name) \
+	static void name(bench::State&); \
+	static bench::Registrar name##Registrar(#name, name); \
+	static void name(bench::State &state)
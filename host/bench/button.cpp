@@ -0,0 +1,50 @@
+#include "../../common/button.h"
+
+#include "bench.h"
+
+BENCHMARK(buttonCheck) {
+	gemha::Button button(4);
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		host::setPin(4, (i >> 4) & 1);
+		button.check();
+		bench::doNotOptimize(button.value());
+	}
+}
+
+// light/light.cpp: 11 inputs polled every tick
+BENCHMARK(buttonCheck11) {
+	gemha::Button inputs[11] = {36, 39, 34, 35, 32, 33, 25, 26, 27, 14, 13};
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		host::setPin(36, (i >> 4) & 1);
+		for (auto &b : inputs)
+			b.check();
+		bench::doNotOptimize(inputs[0].value());
+	}
+}
+
+// interrupt mode: one bouncing press, edges plus timer confirmation
+BENCHMARK(buttonInterrupt) {
+	gemha::Button button(5);
+	button.attach();
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		bool level = !(i & 1);
+		host::setPin(5, level);
+		host::setPin(5, !level);
+		host::setPin(5, level);
+		delay(10);
+		bench::doNotOptimize(button.value());
+	}
+	button.detach();
+}
+
+// same 11 inputs as buttonCheck11, one register sample per tick
+BENCHMARK(buttonBankCheck11) {
+	gemha::ButtonBank<11> inputs = {36, 39, 34, 35, 32, 33, 25, 26, 27, 14, 13};
+	uint64_t changes = 0;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		host::setPin(36, (i >> 4) & 1);
+		changes += inputs.check() != 0;
+		bench::doNotOptimize(inputs[0]);
+	}
+	state.count("changes", changes);
+}
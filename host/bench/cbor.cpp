@@ -0,0 +1,52 @@
+#include "../../common/batch.h"
+#include "../tools/cbor.h"
+
+#include "bench.h"
+
+namespace {
+
+// DS18B20 readings in 1/16 °C steps
+float temperature(uint64_t i) {
+	return 18.0 + (i & 127) / 16.0;
+}
+
+} // namespace
+
+// one temperature payload, the way Temperature::publish formats it
+BENCHMARK(encodeValueText) {
+	uint8_t buf[gemha::VALUE_MAX];
+	uint64_t bytes = 0;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		bytes += gemha::encodeValue(buf, temperature(i), 1, gemha::TEXT);
+		bench::doNotOptimize(buf);
+	}
+	state.count("B", bytes);
+}
+
+BENCHMARK(encodeValueCbor) {
+	uint8_t buf[gemha::VALUE_MAX];
+	uint64_t bytes = 0;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		bytes += gemha::encodeValue(buf, temperature(i), 1, gemha::CBOR);
+		bench::doNotOptimize(buf);
+	}
+	state.count("B", bytes);
+}
+
+// a garage PZEM batch as CBOR, and back to JSON on the consumer's side
+BENCHMARK(cborToJson) {
+	PubSubClient client;
+	client.connect("bench");
+	static const char *names[] = { "voltage", "current", "power", "energy", "frequency", "pf" };
+	float vals[] = { 230.1, 1.234, 283.9, 1234.567, 50, 0.98 };
+	gemha::publishBatch(client, "house/garage/power/0", [&](gemha::Batch &batch) {
+		for (auto j = 0; j < 6; j++)
+			batch.add(names[j], vals[j], 3);
+	}, gemha::CBOR);
+	std::string json;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		json.clear();
+		host::cborToJson(client.lastPayload, client.lastLength, json);
+		bench::doNotOptimize(json);
+	}
+}
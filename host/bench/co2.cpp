@@ -0,0 +1,33 @@
+#include "Arduino.h"
+#include "Wire.h"
+
+#include "../../co2/AM2321.h"
+#include "../../common/co2.h"
+
+#include "bench.h"
+
+BENCHMARK(am2321Read) {
+	// humidity 52.3 %, temperature 21.5 °C, CRC16/MODBUS
+	static const uint8_t frame[] = { 0x03, 0x04, 0x02, 0x0B, 0x00, 0xD7, 0xC1, 0xCC };
+	memcpy(Wire.rx, frame, sizeof(frame));
+	Wire.rxLength = sizeof(frame);
+
+	AM2321 am2321;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		bench::doNotOptimize(am2321.read());
+	}
+	bench::doNotOptimize(am2321.temperature);
+}
+
+BENCHMARK(co2Parse) {
+	byte response[gemha::CO2_FRAME] = { 0xFF, 0x86, 0x02, 0x60, 0x47, 0x00, 0x00, 0x00, 0x00 };
+	byte crc = 0;
+	for (int i = 1; i < 8; i++)
+		crc += response[i];
+	response[8] = 255 - crc + 1;
+
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		bench::doNotOptimize(response);
+		bench::doNotOptimize(gemha::parseCO2(response));
+	}
+}
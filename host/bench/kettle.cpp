@@ -0,0 +1,14 @@
+#include "Arduino.h"
+
+#include "bench.h"
+
+namespace temp {
+float readTemperature();
+}
+
+BENCHMARK(kettleReadTemperature) {
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		host::analogLevel[A0] = 300 + (i & 2047);
+		bench::doNotOptimize(temp::readTemperature());
+	}
+}
@@ -0,0 +1,119 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t allocations = 0;
+
+// Count every heap allocation, operator new included, by wrapping glibc.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+	allocations++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+}
+
+namespace bench {
+
+static const int MAX_BENCHMARKS = 128;
+
+struct Entry {
+	const char *name;
+	Function function;
+};
+static Entry entries[MAX_BENCHMARKS];
+static int entryCount = 0;
+
+Registrar::Registrar(const char *name, Function f) {
+	if (entryCount < MAX_BENCHMARKS)
+		entries[entryCount++] = { name, f };
+}
+
+void State::count(const char *name, uint64_t value) {
+	for (int i = 0; i < counters; i++) {
+		if (strcmp(names[i], name) == 0) {
+			values[i] += value;
+			return;
+		}
+	}
+	if (counters < COUNTERS) {
+		names[counters] = name;
+		values[counters++] = value;
+	}
+}
+
+static uint64_t nanos() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t run(const Entry &e, State &state, uint64_t iterations) {
+	state.iterations = iterations;
+	state.counters = 0;
+	uint64_t start = nanos();
+	e.function(state);
+	return nanos() - start;
+}
+
+static void measure(const Entry &e, uint64_t minNanos) {
+	State state;
+	uint64_t iterations = 1;
+	uint64_t elapsed = run(e, state, iterations);
+	while (elapsed < minNanos && iterations < (uint64_t(1) << 40)) {
+		uint64_t next = elapsed ? iterations * minNanos / elapsed * 6 / 5 : iterations * 100;
+		iterations = next > iterations * 100 ? iterations * 100 : next + 1;
+		elapsed = run(e, state, iterations);
+	}
+
+	uint64_t allocs = allocations;
+	elapsed = run(e, state, iterations);
+	allocs = allocations - allocs;
+
+	printf("%-40s %12llu %12.1f ns/op %8.2f allocs/op", e.name,
+			(unsigned long long) iterations, double(elapsed) / iterations,
+			double(allocs) / iterations);
+	for (int i = 0; i < state.counters; i++)
+		printf(" %10.1f %s/op", double(state.values[i]) / iterations, state.names[i]);
+	printf("\n");
+}
+
+} // namespace bench
+
+int main(int argc, char **argv) {
+	uint64_t minNanos = 200000000;
+	const char *env = getenv("BENCH_MIN_MS");
+	if (env)
+		minNanos = strtoull(env, nullptr, 10) * 1000000;
+
+	for (int i = 0; i < bench::entryCount; i++) {
+		const auto &e = bench::entries[i];
+		bool selected = argc < 2;
+		for (int a = 1; a < argc; a++)
+			selected |= strstr(e.name, argv[a]) != nullptr;
+		if (selected)
+			bench::measure(e, minNanos);
+	}
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include "../../common/outbox.h"
+
+#include "bench.h"
+
+namespace {
+
+// one garage PZEM sample
+void push(gemha::Outbox<> &outbox, uint64_t i) {
+	char msg[16];
+	snprintf(msg, sizeof(msg), "%.3f", 230.0 + (i & 15) * 0.1);
+	outbox.push("house/garage/power/0/voltage", msg);
+}
+
+} // namespace
+
+// offline: what a queued sample costs in CPU and in flash writes
+BENCHMARK(outboxPush) {
+	host::files.clear();
+	gemha::Outbox<> outbox;
+	outbox.begin();
+	uint64_t bytes = host::flashBytes;
+	uint32_t writes = host::flashWrites;
+	for (uint64_t i = 0; i < state.iterations; i++)
+		push(outbox, i);
+	outbox.flush();
+	state.count("flashB", host::flashBytes - bytes);
+	state.count("flashWrites", host::flashWrites - writes);
+	state.count("dropped", outbox.droppedCount());
+}
+
+// back online: samples queued in batches of 100, drained at full rate
+BENCHMARK(outboxDrain) {
+	host::files.clear();
+	PubSubClient client;
+	client.connect("bench");
+	gemha::Outbox<> outbox;
+	outbox.begin();
+	outbox.setRate(1, 100);
+	uint32_t published = client.published;
+	uint32_t writes = host::flashWrites;
+	for (uint64_t i = 0; i < state.iterations; i += 100) {
+		for (auto j = 0; j < 100; j++)
+			push(outbox, i + j);
+		while (!outbox.empty()) {
+			delay(100);
+			outbox.drain(client);
+		}
+	}
+	state.count("msgs", client.published - published);
+	state.count("flashWrites", host::flashWrites - writes);
+}
@@ -0,0 +1,80 @@
+#include "../../common/payload.h"
+
+#include "bench.h"
+
+namespace {
+
+const char *payloads[] = { "0", "1", "100", "x", "12345678" };
+const char *temperatures[] = { "85", "92.5", "100", "60.25", "hot" };
+
+// getValue() before the parsers: copy, terminate, strtoul
+int getValueStrtoul(const byte *payload, unsigned int length) {
+	char buf[8];
+	memset(buf, 0, sizeof(buf));
+	if (length >= sizeof(buf))
+		return -1;
+
+	memcpy(buf, payload, length);
+	char *dummy;
+	int value = strtoul(buf, &dummy, 10);
+	if (dummy == buf)
+		return -1;
+	return value;
+}
+
+// the kettle's target temperature before parseFixed()
+bool strtofCopy(const byte *payload, unsigned int length, float &value) {
+	char buf[16];
+	memset(buf, 0, sizeof(buf));
+	if (length >= sizeof(buf))
+		return false;
+	memcpy(buf, payload, length);
+
+	char *end;
+	value = strtof(buf, &end);
+	return end != buf;
+}
+
+} // namespace
+
+BENCHMARK(getValue) {
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		auto p = payloads[i % 5];
+		bench::doNotOptimize(gemha::getValue((const byte*) p, strlen(p)));
+	}
+}
+
+BENCHMARK(getValueStrtoul) {
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		auto p = payloads[i % 5];
+		bench::doNotOptimize(getValueStrtoul((const byte*) p, strlen(p)));
+	}
+}
+
+BENCHMARK(parseFixed) {
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		auto p = temperatures[i % 5];
+		long value = 0;
+		bench::doNotOptimize(gemha::parseFixed((const byte*) p, strlen(p), 2, -100000, 100000, value));
+		bench::doNotOptimize(value);
+	}
+}
+
+BENCHMARK(parseStrtof) {
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		auto p = temperatures[i % 5];
+		float value = 0;
+		bench::doNotOptimize(strtofCopy((const byte*) p, strlen(p), value));
+		bench::doNotOptimize(value);
+	}
+}
+
+BENCHMARK(parseBool) {
+	static const char *bools[] = { "0", "1", "on", "OFF", "maybe" };
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		auto p = bools[i % 5];
+		bool value = false;
+		bench::doNotOptimize(gemha::parseBool((const byte*) p, strlen(p), value));
+		bench::doNotOptimize(value);
+	}
+}
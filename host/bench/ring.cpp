@@ -0,0 +1,23 @@
+#include "../../common/button.h"
+#include "../../common/ring.h"
+
+#include "bench.h"
+
+BENCHMARK(ringPushPop) {
+	gemha::SpscRing<gemha::InputEvent, 32> events;
+	gemha::InputEvent e;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		events.push({uint8_t(i & 7), bool(i & 1), int64_t(i)});
+		events.pop(e);
+		bench::doNotOptimize(e);
+	}
+}
+
+// what an idle publisher loop costs now: one empty pop
+BENCHMARK(ringIdlePop) {
+	gemha::SpscRing<gemha::InputEvent, 32> events;
+	gemha::InputEvent e;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		bench::doNotOptimize(events.pop(e));
+	}
+}
@@ -0,0 +1,87 @@
+#include "../../common/router.h"
+
+#include "bench.h"
+
+namespace {
+
+#define TOPIC_PREFIX "house/vent/"
+#define TOPIC_VALVE "valve/"
+#define TOPIC_RELAY "relay/"
+#define TOPIC_RESCAN "rescan"
+
+int handled;
+
+void onRescan(const gemha::TopicMatch &m) {
+	handled++;
+}
+
+void onValve(const gemha::TopicMatch &m) {
+	handled += m.arg[0] + m.value();
+}
+
+void onRelay(const gemha::TopicMatch &m) {
+	handled += m.arg[0] + m.value();
+}
+
+constexpr gemha::TopicRoute routes[] = {
+	{ TOPIC_PREFIX TOPIC_RESCAN, onRescan },
+	{ TOPIC_PREFIX TOPIC_VALVE "+", onValve },
+	{ TOPIC_PREFIX TOPIC_RELAY "+", onRelay },
+};
+constexpr auto router = gemha::topicRouter(routes);
+
+// what vent.cpp subscribes to, plus one it doesn't handle
+const char *topics[] = {
+	"house/vent/valve/11",
+	"house/vent/relay/2",
+	"house/vent/rescan",
+	"house/vent/valve/3",
+	"house/vent/temp/28ff641e8016034a",
+};
+
+// vent.cpp's callbackMqtt before the router
+void strncmpChain(char *topic, const byte *payload, unsigned int length) {
+	if (strncmp(topic, TOPIC_PREFIX, sizeof(TOPIC_PREFIX) - 1) != 0)
+		return;
+	topic += sizeof(TOPIC_PREFIX) - 1;
+
+	if (strcmp(topic, TOPIC_RESCAN) == 0) {
+		handled++;
+		return;
+	}
+
+	if (strncmp(topic, TOPIC_VALVE, sizeof(TOPIC_VALVE) - 1) == 0)
+		topic += sizeof(TOPIC_VALVE) - 1;
+	else if (strncmp(topic, TOPIC_RELAY, sizeof(TOPIC_RELAY) - 1) == 0)
+		topic += sizeof(TOPIC_RELAY) - 1;
+	else
+		return;
+
+	char *dummy;
+	int channel = strtoul(topic, &dummy, 10);
+	if (dummy == topic)
+		return;
+
+	int value = gemha::getValue(payload, length);
+	if (value == -1)
+		return;
+	handled += channel + value;
+}
+
+} // namespace
+
+BENCHMARK(routeStrncmp) {
+	handled = 0;
+	for (uint64_t i = 0; i < state.iterations; i++)
+		strncmpChain(const_cast<char*>(topics[i % 5]), (const byte*) "50", 2);
+	bench::doNotOptimize(handled);
+}
+
+BENCHMARK(routeTopic) {
+	handled = 0;
+	uint64_t routed = 0;
+	for (uint64_t i = 0; i < state.iterations; i++)
+		routed += router.dispatch(topics[i % 5], (const byte*) "50", 2);
+	bench::doNotOptimize(handled);
+	state.count("routed", routed);
+}
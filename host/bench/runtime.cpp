@@ -0,0 +1,47 @@
+#include "../../common/runtime.h"
+
+#include "bench.h"
+
+namespace {
+
+void idle(void*) {
+}
+
+// The shim never runs tasks and every handle is nullptr: the first one
+// started stands for the calling task.
+void startOnce() {
+	static bool started = false;
+	if (!started)
+		started = gemha::startTask({ "bench", idle, 2048, 1, gemha::APP_CORE });
+}
+
+} // namespace
+
+// what the accounting adds to a wait
+BENCHMARK(taskDelayAccounting) {
+	startOnce();
+	for (uint64_t i = 0; i < state.iterations; i++)
+		gemha::taskDelay(0);
+}
+
+// 1 ms of work per 10 ms reads back as 10 %, sampled every second
+BENCHMARK(taskCpuSample) {
+	startOnce();
+	const char *names[gemha::TaskTable::TASKS_MAX];
+	float percent[gemha::TaskTable::TASKS_MAX];
+	gemha::taskTable().sample(names, percent);
+	double sum = 0;
+	uint64_t samples = 0;
+	for (uint64_t i = 1; i <= state.iterations; i++) {
+		delayMicroseconds(1000);
+		gemha::taskDelay(9);
+		if (i % 100 == 0) {
+			gemha::taskTable().sample(names, percent);
+			sum += percent[0];
+			samples++;
+		}
+	}
+	// counters are reported per iteration
+	if (samples > 0)
+		state.count("permille", lrint(sum * 10 / samples) * state.iterations);
+}
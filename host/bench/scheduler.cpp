@@ -0,0 +1,62 @@
+#include "../../common/scheduler.h"
+
+#include "bench.h"
+
+namespace {
+
+// light after a reconnect: the forced full state, 11 inputs and 8 relays,
+// posted twice (force and the periodic one in a row), then an input change
+void burst(gemha::Scheduler &outgoing) {
+	char topic[32];
+	for (auto k = 0; k < 2; k++) {
+		for (auto j = 0; j < 19; j++) {
+			snprintf(topic, sizeof(topic), "house/light1/%s/%d", j < 11 ? "input" : "relay", j % 11);
+			outgoing.post(topic, j & 1 ? "1" : "0", gemha::PRIORITY_TELEMETRY);
+		}
+	}
+	outgoing.post("house/light1/input/12", "1", gemha::PRIORITY_CHANGE);
+}
+
+} // namespace
+
+// CPU per message through post() and run()
+BENCHMARK(schedulerBurst) {
+	PubSubClient client;
+	client.connect("bench");
+	gemha::Scheduler outgoing;
+	outgoing.setRate(0, 255);
+	uint32_t published = client.published;
+	for (uint64_t i = 0; i < state.iterations; i += 39) {
+		burst(outgoing);
+		outgoing.run(client);
+	}
+	state.count("msgs", client.published - published);
+	state.count("coalesced", outgoing.coalescedCount());
+}
+
+// ms from the input change to its publish with 20 ms per token, burst 5:
+// behind the full state it would wait for 19 tokens
+BENCHMARK(schedulerChangeLatency) {
+	PubSubClient client;
+	client.connect("bench");
+	gemha::Scheduler outgoing;
+	outgoing.setRate(20, 5);
+	uint64_t latency = 0;
+	uint64_t spread = 0;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		burst(outgoing);
+		unsigned long start = millis();
+		uint32_t changes = outgoing.sentCount(gemha::PRIORITY_CHANGE);
+		while (!outgoing.empty()) {
+			outgoing.run(client);
+			if (outgoing.sentCount(gemha::PRIORITY_CHANGE) != changes) {
+				latency += millis() - start;
+				changes++;
+			}
+			delay(1);
+		}
+		spread += millis() - start;
+	}
+	state.count("changeMs", latency);
+	state.count("burstMs", spread);
+}
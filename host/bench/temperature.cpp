@@ -0,0 +1,232 @@
+#include "../../common/temperature.h"
+
+#include "bench.h"
+
+namespace {
+
+struct Fixture {
+	OneWire oneWire;
+	PubSubClient client;
+	gemha::Temperature temperatures;
+
+	Fixture(int sensors, uint8_t bits = 0) :
+			oneWire(26), temperatures("house/light2/temp/", &oneWire, &client) {
+		for (auto i = 0; i < sensors; i++)
+			oneWire.devices.emplace_back(0x1000 + i * 0x10101, 20.0 + i);
+		client.connect("bench");
+		temperatures.setResolution(bits);
+		temperatures.start();
+		temperatures.readAll();
+	}
+};
+
+} // namespace
+
+BENCHMARK(temperatureSearch8) {
+	Fixture f(8);
+	uint64_t slots = f.oneWire.slots;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		f.temperatures.search();
+	}
+	state.count("slots", f.oneWire.slots - slots);
+}
+
+BENCHMARK(temperatureMeasure8) {
+	Fixture f(8);
+	uint64_t slots = f.oneWire.slots;
+	uint64_t start = millis();
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		f.temperatures.startMeasure();
+		f.temperatures.read();
+	}
+	state.count("slots", f.oneWire.slots - slots);
+	state.count("ms", millis() - start);
+}
+
+BENCHMARK(temperaturePublish8) {
+	Fixture f(8);
+	uint32_t published = f.client.published;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		f.temperatures.publish(true);
+	}
+	state.count("msgs", f.client.published - published);
+}
+
+// 30 s publish period, readings drifting up and down by 0.0625 °C every
+// 10 cycles: everything inside the deadband and the 5 min silence limit
+// is held back
+BENCHMARK(temperaturePublishOnChange8) {
+	Fixture f(8);
+	uint32_t published = f.client.published;
+	uint32_t suppressed = f.temperatures.suppressedCount();
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		if (i % 10 == 0) {
+			float step = (i / 10) % 16 < 8 ? 0.0625 : -0.0625;
+			for (auto &d : f.oneWire.devices)
+				d.temperature += step;
+			f.temperatures.startMeasure();
+			f.temperatures.read();
+		}
+		f.temperatures.publish();
+		delay(30000);
+	}
+	state.count("msgs", f.client.published - published);
+	state.count("suppressed", f.temperatures.suppressedCount() - suppressed);
+}
+
+// non-blocking cycle as in light_enterance, bus polled every 50 ms
+static void conversion(bench::State &state, uint8_t bits) {
+	Fixture f(8, bits);
+	uint64_t slots = f.oneWire.slots;
+	uint64_t start = millis();
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		f.temperatures.startConversion();
+		while (!f.temperatures.ready())
+			delay(50);
+		f.temperatures.read();
+	}
+	state.count("slots", f.oneWire.slots - slots);
+	state.count("ms", millis() - start);
+}
+
+BENCHMARK(temperatureConversion8) {
+	conversion(state, 0);
+}
+
+BENCHMARK(temperatureConversion8Res9) {
+	conversion(state, 9);
+}
+
+BENCHMARK(temperatureConversion8Res10) {
+	conversion(state, 10);
+}
+
+// boot with the ROM table found in NVS: scratchpad check instead of search
+BENCHMARK(temperatureStartCached8) {
+	Fixture f(8);
+	uint64_t slots = f.oneWire.slots;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		gemha::Temperature t("house/light2/temp/", &f.oneWire, &f.client);
+		t.start();
+	}
+	state.count("slots", f.oneWire.slots - slots);
+}
+
+BENCHMARK(temperatureStartCold8) {
+	Fixture f(8);
+	uint64_t slots = f.oneWire.slots;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		host::nvs.clear();
+		gemha::Temperature t("house/light2/temp/", &f.oneWire, &f.client);
+		t.start();
+	}
+	state.count("slots", f.oneWire.slots - slots);
+}
+
+// reader side of the seqlock, as in the water_boiler display task
+BENCHMARK(temperatureSnapshot8) {
+	Fixture f(8);
+	volatile float val;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		auto snap = f.temperatures.snapshot();
+		val = snap.devices[i % snap.count].val;
+	}
+	(void) val;
+}
+
+namespace {
+
+struct BusesFixture {
+	OneWire oneWire[4] = { OneWire(26), OneWire(27), OneWire(32), OneWire(33) };
+	PubSubClient client;
+	gemha::Temperature bus[4] = {
+		{ "house/boiler/temp/", &oneWire[0], &client, "temp0" },
+		{ "house/boiler/temp/", &oneWire[1], &client, "temp1" },
+		{ "house/boiler/temp/", &oneWire[2], &client, "temp2" },
+		{ "house/boiler/temp/", &oneWire[3], &client, "temp3" },
+	};
+	gemha::TemperatureBuses<4> temperatures = { &bus[0], &bus[1], &bus[2], &bus[3] };
+
+	BusesFixture() {
+		for (auto b = 0; b < 4; b++) {
+			for (auto i = 0; i < 8; i++)
+				oneWire[b].devices.emplace_back(0x1000 + b * 0x100000 + i * 0x10101, 20.0 + i);
+		}
+		client.connect("bench");
+		temperatures.start();
+		temperatures.readAll();
+	}
+};
+
+} // namespace
+
+// 4 buses of 8 sensors measured one after the other
+BENCHMARK(temperatureSequential4x8) {
+	BusesFixture f;
+	uint64_t start = millis();
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		for (auto &t : f.bus) {
+			t.startConversion();
+			while (!t.ready())
+				delay(10);
+			t.read();
+		}
+	}
+	state.count("ms", millis() - start);
+}
+
+// same buses converting at once
+BENCHMARK(temperatureBuses4x8) {
+	BusesFixture f;
+	uint64_t start = millis();
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		f.temperatures.startMeasure();
+		f.temperatures.read();
+	}
+	state.count("ms", millis() - start);
+	state.count("sensors", f.temperatures.snapshot().count * state.iterations);
+}
+
+// ROM to slot lookup in a 32 slot table
+BENCHMARK(temperatureFind32) {
+	OneWire oneWire(26);
+	PubSubClient client;
+	for (auto i = 0; i < 32; i++)
+		oneWire.devices.emplace_back(0x1000 + i * 0x10101, 20.0);
+	gemha::BasicTemperature<32> temperatures("house/boiler/temp/", &oneWire, &client, "find");
+	temperatures.start();
+	int found = 0;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		found += temperatures.find(oneWire.devices[i % 32].rom) >= 0;
+	}
+	state.count("found", found);
+}
+
+// 32 sensors, one of them warming up by 0.5 °C per cycle: plain reads of
+// every scratchpad against the alarm search in hysteresis mode
+static void stableBus(bench::State &state, uint8_t band) {
+	OneWire oneWire(26);
+	PubSubClient client;
+	for (auto i = 0; i < 32; i++)
+		oneWire.devices.emplace_back(0x1000 + i * 0x10101, 20.0);
+	gemha::BasicTemperature<32> temperatures("house/boiler/temp/", &oneWire, &client, "stable");
+	temperatures.setAlarmBand(band, 600000);
+	temperatures.start();
+	temperatures.readAll();
+	uint64_t slots = oneWire.slots;
+	for (uint64_t i = 0; i < state.iterations; i++) {
+		auto &d = oneWire.devices[5];
+		d.temperature = d.temperature < 80 ? d.temperature + 0.5 : 20.0;
+		temperatures.startMeasure();
+		temperatures.read();
+	}
+	state.count("slots", oneWire.slots - slots);
+}
+
+BENCHMARK(temperatureStableRead32) {
+	stableBus(state, 0);
+}
+
+BENCHMARK(temperatureStableAlarm32) {
+	stableBus(state, 1);
+}
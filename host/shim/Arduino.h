@@ -0,0 +1,100 @@
+#pragma once
+
+// Host (Linux) stand-in for the ESP32 Arduino core. Only the parts used by
+// common/ and the firmware logic are provided. Time and GPIO are simulated
+// through the host:: namespace so benchmarks can drive them.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "freertos/FreeRTOS.h"
+#include "Print.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT             0x01
+#define OUTPUT            0x03
+#define PULLUP            0x04
+#define INPUT_PULLUP      0x05
+#define PULLDOWN          0x08
+#define INPUT_PULLDOWN    0x09
+#define OPEN_DRAIN        0x10
+#define OUTPUT_OPEN_DRAIN 0x12
+
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+#define A0 36
+
+#define IRAM_ATTR
+#define F(s) (s)
+
+#define digitalPinToInterrupt(p) (p)
+
+using std::abs;
+using std::isinf;
+using std::isnan;
+using std::max;
+using std::min;
+using ::round;
+
+namespace host {
+
+static const uint8_t PIN_COUNT = 40;
+
+// read only, change inputs with setPin()
+extern uint8_t pinLevel[PIN_COUNT];
+extern uint8_t pinModes[PIN_COUNT];
+extern int analogLevel[PIN_COUNT];
+extern uint64_t nowMicros;
+
+void setPin(uint8_t pin, uint8_t level);
+void advance(unsigned long ms);
+
+} // namespace host
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+uint16_t analogRead(uint8_t pin);
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+class HardwareSerial : public Print {
+public:
+	void begin(unsigned long) {
+	}
+	size_t write(uint8_t) override {
+		return 1;
+	}
+	size_t write(const uint8_t*, size_t size) override {
+		return size;
+	}
+	using Print::write;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
@@ -0,0 +1,77 @@
+#pragma once
+
+// Subset of DallasTemperature 3.9 implemented over the simulated OneWire bus.
+
+#include "OneWire.h"
+
+typedef uint8_t DeviceAddress[8];
+typedef uint8_t ScratchPad[9];
+
+#define DEVICE_DISCONNECTED_C -127
+#define DEVICE_DISCONNECTED_RAW -7040
+
+#define DS18S20MODEL 0x10
+#define DS18B20MODEL 0x28
+#define DS1822MODEL  0x22
+#define DS1825MODEL  0x3B
+#define DS28EA00MODEL 0x42
+
+class DallasTemperature {
+public:
+	DallasTemperature();
+	DallasTemperature(OneWire *wire);
+
+	void setOneWire(OneWire *wire);
+	void begin(void);
+
+	uint8_t getDeviceCount(void);
+	bool validAddress(const uint8_t *deviceAddress);
+	bool validFamily(const uint8_t *deviceAddress);
+	bool getAddress(uint8_t *deviceAddress, uint8_t index);
+
+	bool isConnected(const uint8_t *deviceAddress);
+	bool isConnected(const uint8_t *deviceAddress, uint8_t *scratchPad);
+	bool readScratchPad(const uint8_t *deviceAddress, uint8_t *scratchPad);
+	void writeScratchPad(const uint8_t *deviceAddress, const uint8_t *scratchPad);
+	bool readPowerSupply(const uint8_t *deviceAddress = nullptr);
+
+	uint8_t getResolution();
+	void setResolution(uint8_t newResolution);
+	uint8_t getResolution(const uint8_t *deviceAddress);
+	bool setResolution(const uint8_t *deviceAddress, uint8_t newResolution,
+			bool skipGlobalBitResolutionCalculation = false);
+
+	void setWaitForConversion(bool flag);
+	bool getWaitForConversion(void);
+	void setCheckForConversion(bool flag);
+	bool getCheckForConversion(void);
+
+	void requestTemperatures(void);
+	bool requestTemperaturesByAddress(const uint8_t *deviceAddress);
+	bool isConversionComplete(void);
+	int16_t millisToWaitForConversion(uint8_t bitResolution);
+
+	int16_t getTemp(const uint8_t *deviceAddress);
+	float getTempC(const uint8_t *deviceAddress);
+	float rawToCelsius(int16_t raw);
+
+	bool isParasitePowerMode(void);
+
+	void setHighAlarmTemp(const uint8_t *deviceAddress, int8_t celsius);
+	void setLowAlarmTemp(const uint8_t *deviceAddress, int8_t celsius);
+	int8_t getHighAlarmTemp(const uint8_t *deviceAddress);
+	int8_t getLowAlarmTemp(const uint8_t *deviceAddress);
+	void resetAlarmSearch(void);
+	bool alarmSearch(uint8_t *newAddr);
+	bool hasAlarm(const uint8_t *deviceAddress);
+
+private:
+	void blockTillConversionComplete(uint8_t bitResolution);
+
+	OneWire *_wire = nullptr;
+	bool parasite = false;
+	uint8_t bitResolution = 9;
+	bool waitForConversion = true;
+	bool checkForConversion = true;
+	uint8_t devices = 0;
+};
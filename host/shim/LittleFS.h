@@ -0,0 +1,59 @@
+#pragma once
+
+// LittleFS stand-in: files kept in memory for the life of the process, with
+// the bytes and appends written counted to show flash wear.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace host {
+// path -> content, clear() to simulate a formatted file system
+extern std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+extern uint64_t flashBytes;
+extern uint32_t flashWrites;
+}
+
+class File {
+public:
+	File() {
+	}
+	File(std::shared_ptr<std::vector<uint8_t>> data, bool append);
+
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buf, size_t size);
+	size_t read(uint8_t *buf, size_t size);
+	int read();
+	bool seek(uint32_t pos);
+	size_t position() const;
+	size_t size() const;
+	void close();
+
+	operator bool() const {
+		return data != nullptr;
+	}
+
+private:
+	std::shared_ptr<std::vector<uint8_t>> data;
+	size_t pos = 0;
+	bool wrote = false;
+};
+
+class LittleFSFS {
+public:
+	bool begin(bool formatOnFail = false);
+	void end();
+	bool format();
+
+	// "r", "w" and "a"
+	File open(const char *path, const char *mode = "r");
+	bool exists(const char *path);
+	bool remove(const char *path);
+	bool mkdir(const char *path);
+};
+
+extern LittleFSFS LittleFS;
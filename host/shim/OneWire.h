@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <vector>
+
+namespace host {
+
+// Simulated DS18B20 sitting on a OneWire bus.
+struct Ds18b20 {
+	uint8_t rom[8];
+	float temperature = 20.0;
+	bool present = true;
+
+	uint8_t scratchpad[9];
+	uint8_t eeprom[3];
+	unsigned long convertStart = 0;
+	bool converting = false;
+
+	Ds18b20(uint64_t serial, float temperature = 20.0);
+
+	uint8_t resolution() const;
+	uint16_t conversionMillis() const;
+	void convert();
+	void finishConversion();
+	bool alarm() const;
+};
+
+} // namespace host
+
+// Byte/bit level OneWire replacement that talks to simulated devices. It
+// keeps the same API as the OneWire 2.3 library and counts the time slots
+// a real bus would spend, so bus cost can be reported next to CPU time.
+class OneWire {
+public:
+	OneWire(uint8_t pin);
+
+	uint8_t reset(void);
+	void select(const uint8_t rom[8]);
+	void skip(void);
+	void write(uint8_t v, uint8_t power = 0);
+	void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+	uint8_t read(void);
+	void read_bytes(uint8_t *buf, uint16_t count);
+	void write_bit(uint8_t v);
+	uint8_t read_bit(void);
+	void depower(void);
+
+	void reset_search();
+	void target_search(uint8_t family_code);
+	bool search(uint8_t *newAddr, bool search_mode = true);
+
+	static uint8_t crc8(const uint8_t *addr, uint8_t len);
+	static bool check_crc16(const uint8_t *input, uint16_t len,
+			const uint8_t *inverted_crc, uint16_t crc = 0);
+	static uint16_t crc16(const uint8_t *input, uint16_t len, uint16_t crc = 0);
+
+	// simulation, up to 64 devices
+	std::vector<host::Ds18b20> devices;
+	uint8_t pin;
+	uint64_t slots = 0;
+	uint32_t resets = 0;
+
+private:
+	enum State {
+		IDLE, ROM_COMMAND, MATCH_ROM, FUNCTION, READ_SCRATCHPAD, WRITE_SCRATCHPAD,
+		CONVERTING, READ_POWER
+	};
+	void selectAll();
+	void function(uint8_t cmd);
+
+	State state = IDLE;
+	uint64_t selected = 0;
+	uint8_t matchBuf[8];
+	uint8_t pos = 0;
+
+	uint8_t romNo[8];
+	int lastDiscrepancy;
+	int lastFamilyDiscrepancy;
+	bool lastDeviceFlag;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+// NVS Preferences stand-in, kept in memory for the life of the process.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace host {
+// namespace/key -> value, clear() to simulate erased flash
+extern std::map<std::string, std::vector<uint8_t>> nvs;
+extern uint32_t nvsWrites;
+}
+
+class Preferences {
+public:
+	bool begin(const char *name, bool readOnly = false, const char *partition_label = nullptr);
+	void end();
+
+	bool clear();
+	bool remove(const char *key);
+	bool isKey(const char *key);
+
+	size_t putBytes(const char *key, const void *value, size_t len);
+	size_t getBytesLength(const char *key);
+	size_t getBytes(const char *key, void *buf, size_t maxLen);
+
+	size_t putUInt(const char *key, uint32_t value);
+	uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+
+private:
+	std::string path(const char *key) const;
+
+	std::string name;
+	bool readOnly = false;
+	bool started = false;
+};
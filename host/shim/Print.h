@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DEC 10
+#define HEX 16
+
+class Print {
+public:
+	virtual ~Print() {
+	}
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size) {
+		size_t n = 0;
+		while (size--)
+			n += write(*buffer++);
+		return n;
+	}
+	size_t write(const char *str) {
+		return str ? write((const uint8_t*) str, strlen(str)) : 0;
+	}
+
+	size_t print(const char *s) {
+		return write(s);
+	}
+	size_t print(char c) {
+		return write((uint8_t) c);
+	}
+	size_t print(long n, int base = DEC) {
+		char buf[24];
+		snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%ld", n);
+		return write(buf);
+	}
+	size_t print(unsigned long n, int base = DEC) {
+		char buf[24];
+		snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+		return write(buf);
+	}
+	size_t print(int n, int base = DEC) {
+		return print(long(n), base);
+	}
+	size_t print(unsigned n, int base = DEC) {
+		return print((unsigned long) n, base);
+	}
+	size_t print(unsigned char n, int base = DEC) {
+		return print((unsigned long) n, base);
+	}
+	size_t print(double n, int digits = 2) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.*f", digits, n);
+		return write(buf);
+	}
+
+	template<typename T>
+	size_t println(T v) {
+		size_t n = print(v);
+		return n + println();
+	}
+	template<typename T>
+	size_t println(T v, int f) {
+		size_t n = print(v, f);
+		return n + println();
+	}
+	size_t println() {
+		return write("\r\n");
+	}
+
+	size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+		char buf[128];
+		va_list args;
+		va_start(args, format);
+		int len = vsnprintf(buf, sizeof(buf), format, args);
+		va_end(args);
+		if (len < 0)
+			return 0;
+		return write((const uint8_t*) buf, len < int(sizeof(buf)) ? len : sizeof(buf) - 1);
+	}
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+// PubSubClient 2.8 API over an in-memory broker stand-in. Publishes are
+// counted and the last one is kept so benchmarks can check the output.
+
+#include "Arduino.h"
+#include "Client.h"
+
+#include <functional>
+
+class IPAddress;
+
+#define MQTT_MAX_PACKET_SIZE 256
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient : public Print {
+public:
+	PubSubClient();
+	PubSubClient(Client &client);
+
+	PubSubClient& setServer(const char *domain, uint16_t port);
+	PubSubClient& setServer(IPAddress ip, uint16_t port); // not simulated
+	PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+	PubSubClient& setClient(Client &client);
+	PubSubClient& setKeepAlive(uint16_t keepAlive);
+	PubSubClient& setSocketTimeout(uint16_t timeout);
+	bool setBufferSize(uint16_t size);
+	uint16_t getBufferSize();
+
+	bool connect(const char *id);
+	bool connect(const char *id, const char *user, const char *pass);
+	bool connect(const char *id, const char *user, const char *pass,
+			const char *willTopic, uint8_t willQos, bool willRetain,
+			const char *willMessage, bool cleanSession);
+	void disconnect();
+
+	bool publish(const char *topic, const char *payload);
+	bool publish(const char *topic, const char *payload, bool retained);
+	bool publish(const char *topic, const uint8_t *payload, unsigned int plength);
+	bool publish(const char *topic, const uint8_t *payload, unsigned int plength, bool retained);
+
+	bool beginPublish(const char *topic, unsigned int plength, bool retained);
+	int endPublish();
+	size_t write(uint8_t) override;
+	size_t write(const uint8_t *buffer, size_t size) override;
+	using Print::write;
+
+	bool subscribe(const char *topic);
+	bool subscribe(const char *topic, uint8_t qos);
+	bool unsubscribe(const char *topic);
+	bool loop();
+	bool connected();
+	int state();
+
+	// simulation
+	void deliver(const char *topic, const uint8_t *payload, unsigned int length);
+
+	bool online = true;
+	bool cleanSession = true;
+	uint32_t connects = 0;
+	uint32_t published = 0;
+	uint32_t subscribed = 0;
+	uint64_t bytes = 0;
+	char lastTopic[128];
+	uint8_t lastPayload[MQTT_MAX_PACKET_SIZE];
+	unsigned int lastLength = 0;
+
+private:
+	MQTT_CALLBACK_SIGNATURE;
+	bool isConnected = false;
+	unsigned int pending = 0;
+};
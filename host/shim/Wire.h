@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Arduino.h"
+
+// I2C master stand-in. requestFrom() hands out the bytes queued in rx[].
+class TwoWire {
+public:
+	void begin() {
+	}
+	void begin(int, int) {
+	}
+	void beginTransmission(uint8_t) {
+	}
+	uint8_t endTransmission(bool = true) {
+		return 0;
+	}
+	size_t write(uint8_t) {
+		return 1;
+	}
+	uint8_t requestFrom(uint8_t, uint8_t quantity) {
+		pos = 0;
+		return quantity < rxLength ? quantity : rxLength;
+	}
+	uint8_t requestFrom(int address, int quantity) {
+		return requestFrom(uint8_t(address), uint8_t(quantity));
+	}
+	int available() {
+		return rxLength - pos;
+	}
+	int read() {
+		return pos < rxLength ? rx[pos++] : -1;
+	}
+
+	// simulation
+	uint8_t rx[32];
+	uint8_t rxLength = 0;
+
+private:
+	uint8_t pos = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,269 @@
+#include "Arduino.h"
+#include "Wire.h"
+#include "esp_timer.h"
+#include "soc/gpio_reg.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial2;
+TwoWire Wire;
+
+namespace host {
+
+uint8_t pinLevel[PIN_COUNT];
+uint8_t pinModes[PIN_COUNT];
+int analogLevel[PIN_COUNT];
+uint64_t nowMicros = 0;
+
+struct Interrupt {
+	void (*isr)(void*);
+	void *arg;
+	int mode;
+};
+static Interrupt interrupts[PIN_COUNT];
+
+static void callPlain(void *isr) {
+	reinterpret_cast<void (*)()>(isr)();
+}
+
+// packed copy of pinLevel as seen through GPIO_IN_REG/GPIO_IN1_REG
+static uint32_t gpioIn[2];
+
+static void storePin(uint8_t pin, uint8_t level) {
+	pinLevel[pin] = level;
+	uint32_t bit = uint32_t(1) << (pin & 31);
+	if (level)
+		gpioIn[pin >> 5] |= bit;
+	else
+		gpioIn[pin >> 5] &= ~bit;
+}
+
+void setPin(uint8_t pin, uint8_t level) {
+	uint8_t prev = pinLevel[pin];
+	storePin(pin, level);
+	auto &i = interrupts[pin];
+	if (i.isr == nullptr || prev == level)
+		return;
+	if (i.mode == CHANGE || (i.mode == RISING && level) || (i.mode == FALLING && !level))
+		i.isr(i.arg);
+}
+
+} // namespace host
+
+struct esp_timer {
+	esp_timer_cb_t callback;
+	void *arg;
+	uint64_t deadline;
+	uint64_t period;
+	bool armed;
+};
+
+namespace host {
+
+static const int TIMER_MAX = 64;
+static esp_timer timers[TIMER_MAX];
+static int timerCount = 0;
+
+static void advanceMicros(uint64_t us) {
+	uint64_t target = nowMicros + us;
+	for (;;) {
+		esp_timer *next = nullptr;
+		for (int i = 0; i < timerCount; i++) {
+			auto &t = timers[i];
+			if (t.armed && t.deadline <= target && (!next || t.deadline < next->deadline))
+				next = &t;
+		}
+		if (next == nullptr)
+			break;
+		if (next->deadline > nowMicros)
+			nowMicros = next->deadline;
+		if (next->period)
+			next->deadline += next->period;
+		else
+			next->armed = false;
+		next->callback(next->arg);
+	}
+	nowMicros = target;
+}
+
+uint32_t readRegister(uint32_t reg) {
+	return gpioIn[reg == GPIO_IN1_REG];
+}
+
+void advance(unsigned long ms) {
+	advanceMicros(uint64_t(ms) * 1000);
+}
+
+} // namespace host
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+	// reuse a deleted timer first
+	esp_timer *t = nullptr;
+	for (int i = 0; i < host::timerCount && t == nullptr; i++) {
+		if (host::timers[i].callback == nullptr)
+			t = &host::timers[i];
+	}
+	if (t == nullptr) {
+		if (host::timerCount == host::TIMER_MAX)
+			return ESP_ERR_NO_MEM;
+		t = &host::timers[host::timerCount++];
+	}
+	*t = { args->callback, args->arg, 0, 0, false };
+	*handle = t;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+	if (timer->armed)
+		return ESP_ERR_INVALID_STATE;
+	timer->deadline = host::nowMicros + timeout_us;
+	timer->period = 0;
+	timer->armed = true;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+	if (timer->armed)
+		return ESP_ERR_INVALID_STATE;
+	timer->deadline = host::nowMicros + period;
+	timer->period = period;
+	timer->armed = true;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+	if (!timer->armed)
+		return ESP_ERR_INVALID_STATE;
+	timer->armed = false;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+	timer->armed = false;
+	timer->callback = nullptr;
+	return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+	return host::nowMicros;
+}
+
+unsigned long millis() {
+	return host::nowMicros / 1000;
+}
+
+unsigned long micros() {
+	return host::nowMicros;
+}
+
+void delay(uint32_t ms) {
+	host::advance(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+	host::advanceMicros(us);
+}
+
+void yield() {
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+	host::pinModes[pin] = mode;
+	if (mode & PULLUP)
+		host::storePin(pin, HIGH);
+}
+
+int digitalRead(uint8_t pin) {
+	return host::pinLevel[pin];
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+	host::storePin(pin, val ? HIGH : LOW);
+}
+
+uint16_t analogRead(uint8_t pin) {
+	return host::analogLevel[pin];
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+	host::interrupts[pin] = { host::callPlain, reinterpret_cast<void*>(isr), mode };
+}
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void *arg, int mode) {
+	host::interrupts[pin] = { isr, arg, mode };
+}
+
+void detachInterrupt(uint8_t pin) {
+	host::interrupts[pin] = { nullptr, nullptr, 0 };
+}
+
+long random(long max) {
+	return max > 0 ? ::random() % max : 0;
+}
+
+long random(long min, long max) {
+	return min < max ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+	srandom(seed);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t,
+		TaskHandle_t *handle) {
+	if (handle)
+		*handle = nullptr;
+	return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name,
+		uint32_t stackDepth, void *param, UBaseType_t priority,
+		TaskHandle_t *handle, BaseType_t) {
+	return xTaskCreate(code, name, stackDepth, param, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t) {
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+	return nullptr;
+}
+
+void vTaskDelay(TickType_t ticks) {
+	host::advance(ticks * portTICK_PERIOD_MS);
+}
+
+TickType_t xTaskGetTickCount() {
+	return millis() / portTICK_PERIOD_MS;
+}
+
+static uint32_t notifications = 0;
+
+BaseType_t xTaskNotifyGive(TaskHandle_t) {
+	notifications++;
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticks) {
+	if (notifications == 0)
+		vTaskDelay(ticks);
+	uint32_t n = notifications;
+	notifications = clearCountOnExit ? 0 : n ? n - 1 : 0;
+	return n;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+	static int dummy;
+	return reinterpret_cast<SemaphoreHandle_t>(&dummy);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+	return xSemaphoreCreateMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) {
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) {
+	return pdTRUE;
+}
@@ -0,0 +1,290 @@
+#include "DallasTemperature.h"
+
+enum {
+	TEMP_LSB, TEMP_MSB, HIGH_ALARM_TEMP, LOW_ALARM_TEMP, CONFIGURATION,
+	INTERNAL_BYTE, COUNT_REMAIN, COUNT_PER_C, SCRATCHPAD_CRC
+};
+
+#define STARTCONVO      0x44
+#define COPYSCRATCH     0x48
+#define READSCRATCH     0xBE
+#define WRITESCRATCH    0x4E
+#define READPOWERSUPPLY 0xB4
+
+DallasTemperature::DallasTemperature() {
+}
+
+DallasTemperature::DallasTemperature(OneWire *wire) :
+		_wire(wire) {
+}
+
+void DallasTemperature::setOneWire(OneWire *wire) {
+	_wire = wire;
+}
+
+void DallasTemperature::begin(void) {
+	DeviceAddress deviceAddress;
+	_wire->reset_search();
+	devices = 0;
+	while (_wire->search(deviceAddress)) {
+		if (validAddress(deviceAddress)) {
+			if (!parasite && readPowerSupply(deviceAddress))
+				parasite = true;
+			bitResolution = max(bitResolution, getResolution(deviceAddress));
+			devices++;
+		}
+	}
+}
+
+uint8_t DallasTemperature::getDeviceCount(void) {
+	return devices;
+}
+
+bool DallasTemperature::validAddress(const uint8_t *deviceAddress) {
+	return OneWire::crc8(deviceAddress, 7) == deviceAddress[7];
+}
+
+bool DallasTemperature::validFamily(const uint8_t *deviceAddress) {
+	switch (deviceAddress[0]) {
+	case DS18S20MODEL:
+	case DS18B20MODEL:
+	case DS1822MODEL:
+	case DS1825MODEL:
+	case DS28EA00MODEL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool DallasTemperature::getAddress(uint8_t *deviceAddress, uint8_t index) {
+	uint8_t depth = 0;
+	_wire->reset_search();
+	while (depth <= index && _wire->search(deviceAddress)) {
+		if (depth == index && validAddress(deviceAddress))
+			return true;
+		depth++;
+	}
+	return false;
+}
+
+bool DallasTemperature::isConnected(const uint8_t *deviceAddress) {
+	ScratchPad scratchPad;
+	return isConnected(deviceAddress, scratchPad);
+}
+
+bool DallasTemperature::isConnected(const uint8_t *deviceAddress, uint8_t *scratchPad) {
+	bool b = readScratchPad(deviceAddress, scratchPad);
+	bool allZeros = true;
+	for (auto i = 0; i < 9; i++)
+		allZeros &= scratchPad[i] == 0;
+	return b && !allZeros && OneWire::crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC];
+}
+
+bool DallasTemperature::readScratchPad(const uint8_t *deviceAddress, uint8_t *scratchPad) {
+	if (_wire->reset() == 0)
+		return false;
+	_wire->select(deviceAddress);
+	_wire->write(READSCRATCH);
+	for (auto i = 0; i < 9; i++)
+		scratchPad[i] = _wire->read();
+	return _wire->reset() == 1;
+}
+
+void DallasTemperature::writeScratchPad(const uint8_t *deviceAddress, const uint8_t *scratchPad) {
+	_wire->reset();
+	_wire->select(deviceAddress);
+	_wire->write(WRITESCRATCH);
+	_wire->write(scratchPad[HIGH_ALARM_TEMP]);
+	_wire->write(scratchPad[LOW_ALARM_TEMP]);
+	if (deviceAddress[0] != DS18S20MODEL)
+		_wire->write(scratchPad[CONFIGURATION]);
+	_wire->reset();
+
+	_wire->select(deviceAddress);
+	_wire->write(COPYSCRATCH, parasite);
+	delay(20);
+	_wire->reset();
+}
+
+bool DallasTemperature::readPowerSupply(const uint8_t *deviceAddress) {
+	if (_wire->reset() == 0)
+		return false;
+	if (deviceAddress == nullptr)
+		_wire->skip();
+	else
+		_wire->select(deviceAddress);
+	_wire->write(READPOWERSUPPLY);
+	bool ret = _wire->read_bit() == 0;
+	_wire->reset();
+	return ret;
+}
+
+uint8_t DallasTemperature::getResolution() {
+	return bitResolution;
+}
+
+void DallasTemperature::setResolution(uint8_t newResolution) {
+	bitResolution = std::min<uint8_t>(std::max<uint8_t>(newResolution, 9), 12);
+	DeviceAddress deviceAddress;
+	for (uint8_t i = 0; i < devices; i++) {
+		if (getAddress(deviceAddress, i))
+			setResolution(deviceAddress, bitResolution, true);
+	}
+}
+
+uint8_t DallasTemperature::getResolution(const uint8_t *deviceAddress) {
+	if (deviceAddress[0] == DS18S20MODEL)
+		return 12;
+	ScratchPad scratchPad;
+	if (!isConnected(deviceAddress, scratchPad))
+		return 0;
+	return 9 + ((scratchPad[CONFIGURATION] >> 5) & 3);
+}
+
+bool DallasTemperature::setResolution(const uint8_t *deviceAddress, uint8_t newResolution,
+		bool skipGlobalBitResolutionCalculation) {
+	newResolution = std::min<uint8_t>(std::max<uint8_t>(newResolution, 9), 12);
+	if (getResolution(deviceAddress) == newResolution)
+		return true;
+
+	ScratchPad scratchPad;
+	if (!isConnected(deviceAddress, scratchPad))
+		return false;
+	if (deviceAddress[0] != DS18S20MODEL) {
+		scratchPad[CONFIGURATION] = ((newResolution - 9) << 5) | 0x1F;
+		writeScratchPad(deviceAddress, scratchPad);
+		if (!skipGlobalBitResolutionCalculation)
+			bitResolution = max(bitResolution, newResolution);
+	}
+	return true;
+}
+
+void DallasTemperature::setWaitForConversion(bool flag) {
+	waitForConversion = flag;
+}
+
+bool DallasTemperature::getWaitForConversion(void) {
+	return waitForConversion;
+}
+
+void DallasTemperature::setCheckForConversion(bool flag) {
+	checkForConversion = flag;
+}
+
+bool DallasTemperature::getCheckForConversion(void) {
+	return checkForConversion;
+}
+
+void DallasTemperature::requestTemperatures(void) {
+	_wire->reset();
+	_wire->skip();
+	_wire->write(STARTCONVO, parasite);
+	if (!waitForConversion)
+		return;
+	blockTillConversionComplete(bitResolution);
+}
+
+bool DallasTemperature::requestTemperaturesByAddress(const uint8_t *deviceAddress) {
+	uint8_t bits = getResolution(deviceAddress);
+	if (bits == 0)
+		return false;
+	_wire->reset();
+	_wire->select(deviceAddress);
+	_wire->write(STARTCONVO, parasite);
+	if (!waitForConversion)
+		return true;
+	blockTillConversionComplete(bits);
+	return true;
+}
+
+bool DallasTemperature::isConversionComplete(void) {
+	return _wire->read_bit() == 1;
+}
+
+int16_t DallasTemperature::millisToWaitForConversion(uint8_t bitResolution) {
+	switch (bitResolution) {
+	case 9:
+		return 94;
+	case 10:
+		return 188;
+	case 11:
+		return 375;
+	default:
+		return 750;
+	}
+}
+
+// The real library polls the bus until the conversion ends; on the host
+// the simulated clock is simply advanced by the worst case time.
+void DallasTemperature::blockTillConversionComplete(uint8_t bitResolution) {
+	delay(millisToWaitForConversion(bitResolution));
+}
+
+int16_t DallasTemperature::getTemp(const uint8_t *deviceAddress) {
+	ScratchPad scratchPad;
+	if (!isConnected(deviceAddress, scratchPad))
+		return DEVICE_DISCONNECTED_RAW;
+	return int16_t(scratchPad[TEMP_MSB] << 11 | scratchPad[TEMP_LSB] << 3);
+}
+
+float DallasTemperature::getTempC(const uint8_t *deviceAddress) {
+	return rawToCelsius(getTemp(deviceAddress));
+}
+
+float DallasTemperature::rawToCelsius(int16_t raw) {
+	if (raw <= DEVICE_DISCONNECTED_RAW)
+		return DEVICE_DISCONNECTED_C;
+	return float(raw) * 0.0078125f;
+}
+
+bool DallasTemperature::isParasitePowerMode(void) {
+	return parasite;
+}
+
+void DallasTemperature::setHighAlarmTemp(const uint8_t *deviceAddress, int8_t celsius) {
+	ScratchPad scratchPad;
+	if (isConnected(deviceAddress, scratchPad)) {
+		scratchPad[HIGH_ALARM_TEMP] = uint8_t(celsius);
+		writeScratchPad(deviceAddress, scratchPad);
+	}
+}
+
+void DallasTemperature::setLowAlarmTemp(const uint8_t *deviceAddress, int8_t celsius) {
+	ScratchPad scratchPad;
+	if (isConnected(deviceAddress, scratchPad)) {
+		scratchPad[LOW_ALARM_TEMP] = uint8_t(celsius);
+		writeScratchPad(deviceAddress, scratchPad);
+	}
+}
+
+int8_t DallasTemperature::getHighAlarmTemp(const uint8_t *deviceAddress) {
+	ScratchPad scratchPad;
+	if (isConnected(deviceAddress, scratchPad))
+		return int8_t(scratchPad[HIGH_ALARM_TEMP]);
+	return DEVICE_DISCONNECTED_C;
+}
+
+int8_t DallasTemperature::getLowAlarmTemp(const uint8_t *deviceAddress) {
+	ScratchPad scratchPad;
+	if (isConnected(deviceAddress, scratchPad))
+		return int8_t(scratchPad[LOW_ALARM_TEMP]);
+	return DEVICE_DISCONNECTED_C;
+}
+
+void DallasTemperature::resetAlarmSearch(void) {
+	_wire->reset_search();
+}
+
+bool DallasTemperature::alarmSearch(uint8_t *newAddr) {
+	return _wire->search(newAddr, false);
+}
+
+bool DallasTemperature::hasAlarm(const uint8_t *deviceAddress) {
+	ScratchPad scratchPad;
+	if (!isConnected(deviceAddress, scratchPad))
+		return false;
+	int8_t temp = int8_t(scratchPad[TEMP_MSB] << 4 | scratchPad[TEMP_LSB] >> 4);
+	return temp <= int8_t(scratchPad[LOW_ALARM_TEMP])
+			|| temp >= int8_t(scratchPad[HIGH_ALARM_TEMP]);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Task watchdog stand-in, nothing is watched on the host.
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+inline esp_err_t esp_task_wdt_init(uint32_t, bool) {
+	return ESP_OK;
+}
+
+inline esp_err_t esp_task_wdt_add(TaskHandle_t) {
+	return ESP_OK;
+}
+
+inline esp_err_t esp_task_wdt_delete(TaskHandle_t) {
+	return ESP_OK;
+}
+
+inline esp_err_t esp_task_wdt_reset() {
+	return ESP_OK;
+}
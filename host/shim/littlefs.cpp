@@ -0,0 +1,106 @@
+#include "LittleFS.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace host {
+std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+uint64_t flashBytes = 0;
+uint32_t flashWrites = 0;
+}
+
+LittleFSFS LittleFS;
+
+File::File(std::shared_ptr<std::vector<uint8_t>> data, bool append) :
+		data(data), pos(append ? data->size() : 0) {
+}
+
+size_t File::write(uint8_t c) {
+	return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+	if (data == nullptr)
+		return 0;
+	if (pos + size > data->size())
+		data->resize(pos + size);
+	memcpy(data->data() + pos, buf, size);
+	pos += size;
+	host::flashBytes += size;
+	wrote = true;
+	return size;
+}
+
+size_t File::read(uint8_t *buf, size_t size) {
+	if (data == nullptr || pos >= data->size())
+		return 0;
+	size = std::min(size, data->size() - pos);
+	memcpy(buf, data->data() + pos, size);
+	pos += size;
+	return size;
+}
+
+int File::read() {
+	uint8_t c;
+	return read(&c, 1) == 1 ? c : -1;
+}
+
+bool File::seek(uint32_t pos) {
+	if (data == nullptr || pos > data->size())
+		return false;
+	this->pos = pos;
+	return true;
+}
+
+size_t File::position() const {
+	return pos;
+}
+
+size_t File::size() const {
+	return data == nullptr ? 0 : data->size();
+}
+
+// one flash program per closed file that was written
+void File::close() {
+	if (wrote)
+		host::flashWrites++;
+	wrote = false;
+	data = nullptr;
+}
+
+bool LittleFSFS::begin(bool) {
+	return true;
+}
+
+void LittleFSFS::end() {
+}
+
+bool LittleFSFS::format() {
+	host::files.clear();
+	return true;
+}
+
+File LittleFSFS::open(const char *path, const char *mode) {
+	auto it = host::files.find(path);
+	if (mode[0] == 'r')
+		return it == host::files.end() ? File() : File(it->second, false);
+	if (it == host::files.end() || mode[0] == 'w') {
+		auto &data = host::files[path];
+		data = std::make_shared<std::vector<uint8_t>>();
+		return File(data, false);
+	}
+	return File(it->second, mode[0] == 'a');
+}
+
+bool LittleFSFS::exists(const char *path) {
+	return host::files.count(path) != 0;
+}
+
+bool LittleFSFS::remove(const char *path) {
+	return host::files.erase(path) != 0;
+}
+
+bool LittleFSFS::mkdir(const char *) {
+	return true;
+}
@@ -0,0 +1,334 @@
+#include "OneWire.h"
+
+namespace host {
+
+Ds18b20::Ds18b20(uint64_t serial, float temperature) :
+		temperature(temperature) {
+	rom[0] = 0x28;
+	for (auto i = 1; i < 7; i++) {
+		rom[i] = serial & 0xff;
+		serial >>= 8;
+	}
+	rom[7] = OneWire::crc8(rom, 7);
+
+	// power-on state: 85 °C, TH 75, TL 70, 12 bit
+	static const uint8_t powerOn[8] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+	memcpy(scratchpad, powerOn, sizeof(powerOn));
+	scratchpad[8] = OneWire::crc8(scratchpad, 8);
+	memcpy(eeprom, scratchpad + 2, sizeof(eeprom));
+}
+
+uint8_t Ds18b20::resolution() const {
+	return 9 + ((scratchpad[4] >> 5) & 3);
+}
+
+uint16_t Ds18b20::conversionMillis() const {
+	return 750 >> (12 - resolution());
+}
+
+void Ds18b20::convert() {
+	converting = true;
+	convertStart = millis();
+}
+
+void Ds18b20::finishConversion() {
+	converting = false;
+	int16_t raw = lround(temperature * 16);
+	raw &= ~((1 << (12 - resolution())) - 1);
+	scratchpad[0] = raw & 0xff;
+	scratchpad[1] = raw >> 8;
+	scratchpad[8] = OneWire::crc8(scratchpad, 8);
+}
+
+bool Ds18b20::alarm() const {
+	int16_t raw = scratchpad[1] << 8 | scratchpad[0];
+	int8_t t = raw >> 4;
+	return t >= int8_t(scratchpad[2]) || t <= int8_t(scratchpad[3]);
+}
+
+} // namespace host
+
+OneWire::OneWire(uint8_t pin) :
+		pin(pin) {
+	reset_search();
+}
+
+static void update(std::vector<host::Ds18b20> &devices) {
+	auto now = millis();
+	for (auto &d : devices) {
+		if (d.converting && now - d.convertStart >= d.conversionMillis())
+			d.finishConversion();
+	}
+}
+
+uint8_t OneWire::reset(void) {
+	update(devices);
+	resets++;
+	slots += 8;
+	state = ROM_COMMAND;
+	selected = 0;
+	for (auto &d : devices) {
+		if (d.present)
+			return 1;
+	}
+	return 0;
+}
+
+void OneWire::selectAll() {
+	selected = 0;
+	for (size_t i = 0; i < devices.size(); i++) {
+		if (devices[i].present)
+			selected |= uint64_t(1) << i;
+	}
+}
+
+template<typename F>
+static void forEach(std::vector<host::Ds18b20> &devices, uint64_t mask, F f) {
+	for (size_t i = 0; mask; i++, mask >>= 1) {
+		if (mask & 1)
+			f(devices[i]);
+	}
+}
+
+void OneWire::select(const uint8_t rom[8]) {
+	write(0x55);
+	for (auto i = 0; i < 8; i++)
+		write(rom[i]);
+}
+
+void OneWire::skip(void) {
+	write(0xCC);
+}
+
+void OneWire::function(uint8_t cmd) {
+	pos = 0;
+	switch (cmd) {
+	case 0x44:
+		forEach(devices, selected, [](host::Ds18b20 &d) {
+			d.convert();
+		});
+		state = CONVERTING;
+		break;
+	case 0xBE:
+		update(devices);
+		state = READ_SCRATCHPAD;
+		break;
+	case 0x4E:
+		state = WRITE_SCRATCHPAD;
+		break;
+	case 0x48:
+		forEach(devices, selected, [](host::Ds18b20 &d) {
+			memcpy(d.eeprom, d.scratchpad + 2, sizeof(d.eeprom));
+		});
+		state = IDLE;
+		break;
+	case 0xB8:
+		forEach(devices, selected, [](host::Ds18b20 &d) {
+			memcpy(d.scratchpad + 2, d.eeprom, sizeof(d.eeprom));
+			d.scratchpad[8] = crc8(d.scratchpad, 8);
+		});
+		state = IDLE;
+		break;
+	case 0xB4:
+		state = READ_POWER;
+		break;
+	default:
+		state = IDLE;
+	}
+}
+
+void OneWire::write(uint8_t v, uint8_t) {
+	slots += 8;
+	switch (state) {
+	case ROM_COMMAND:
+		if (v == 0x55) {
+			pos = 0;
+			state = MATCH_ROM;
+		} else if (v == 0xCC) {
+			selectAll();
+			state = FUNCTION;
+		} else {
+			state = IDLE;
+		}
+		break;
+	case MATCH_ROM:
+		matchBuf[pos++] = v;
+		if (pos == 8) {
+			selected = 0;
+			for (size_t i = 0; i < devices.size(); i++) {
+				if (devices[i].present && memcmp(devices[i].rom, matchBuf, 8) == 0)
+					selected |= uint64_t(1) << i;
+			}
+			state = FUNCTION;
+		}
+		break;
+	case FUNCTION:
+		function(v);
+		break;
+	case WRITE_SCRATCHPAD:
+		forEach(devices, selected, [&](host::Ds18b20 &d) {
+			d.scratchpad[2 + pos] = v;
+			d.scratchpad[8] = crc8(d.scratchpad, 8);
+		});
+		if (++pos == 3)
+			state = IDLE;
+		break;
+	default:
+		break;
+	}
+}
+
+void OneWire::write_bytes(const uint8_t *buf, uint16_t count, bool power) {
+	for (uint16_t i = 0; i < count; i++)
+		write(buf[i], power);
+}
+
+uint8_t OneWire::read(void) {
+	slots += 8;
+	if (state == READ_SCRATCHPAD && pos < 9) {
+		uint8_t v = 0xff;
+		forEach(devices, selected, [&](host::Ds18b20 &d) {
+			v &= d.scratchpad[pos];
+		});
+		pos++;
+		return v;
+	}
+	return 0xff;
+}
+
+void OneWire::read_bytes(uint8_t *buf, uint16_t count) {
+	for (uint16_t i = 0; i < count; i++)
+		buf[i] = read();
+}
+
+void OneWire::write_bit(uint8_t) {
+	slots++;
+}
+
+uint8_t OneWire::read_bit(void) {
+	slots++;
+	if (state != CONVERTING)
+		return 1;
+	update(devices);
+	bool done = true;
+	forEach(devices, selected, [&](host::Ds18b20 &d) {
+		done &= !d.converting;
+	});
+	return done;
+}
+
+void OneWire::depower(void) {
+}
+
+void OneWire::reset_search() {
+	lastDiscrepancy = 0;
+	lastDeviceFlag = false;
+	lastFamilyDiscrepancy = 0;
+	memset(romNo, 0, sizeof(romNo));
+}
+
+void OneWire::target_search(uint8_t family_code) {
+	romNo[0] = family_code;
+	memset(romNo + 1, 0, sizeof(romNo) - 1);
+	lastDiscrepancy = 64;
+	lastFamilyDiscrepancy = 0;
+	lastDeviceFlag = false;
+}
+
+bool OneWire::search(uint8_t *newAddr, bool search_mode) {
+	if (lastDeviceFlag || !reset()) {
+		reset_search();
+		return false;
+	}
+	slots += 8;
+	state = IDLE;
+	// alarm flags are set at the end of a conversion
+	update(devices);
+
+	uint64_t candidates = 0;
+	for (size_t i = 0; i < devices.size(); i++) {
+		auto &d = devices[i];
+		if (d.present && (search_mode || d.alarm()))
+			candidates |= uint64_t(1) << i;
+	}
+
+	int idBitNumber = 1;
+	int lastZero = 0;
+	for (; idBitNumber <= 64; idBitNumber++) {
+		int byteNumber = (idBitNumber - 1) / 8;
+		uint8_t mask = 1 << ((idBitNumber - 1) % 8);
+
+		uint64_t ones = 0;
+		for (size_t i = 0; i < devices.size(); i++) {
+			if (devices[i].rom[byteNumber] & mask)
+				ones |= uint64_t(1) << i;
+		}
+		// wired-AND of the bit and of its complement
+		bool idBit = (candidates & ~ones) == 0;
+		bool cmpIdBit = (candidates & ones) == 0;
+		slots += 3;
+		if (idBit && cmpIdBit)
+			break;
+
+		bool dir;
+		if (idBit != cmpIdBit) {
+			dir = idBit;
+		} else {
+			if (idBitNumber < lastDiscrepancy)
+				dir = romNo[byteNumber] & mask;
+			else
+				dir = idBitNumber == lastDiscrepancy;
+			if (!dir) {
+				lastZero = idBitNumber;
+				if (lastZero < 9)
+					lastFamilyDiscrepancy = lastZero;
+			}
+		}
+		if (dir)
+			romNo[byteNumber] |= mask;
+		else
+			romNo[byteNumber] &= ~mask;
+
+		candidates &= dir ? ones : ~ones;
+	}
+
+	if (idBitNumber <= 64 || !romNo[0]) {
+		reset_search();
+		return false;
+	}
+	lastDiscrepancy = lastZero;
+	if (lastDiscrepancy == 0)
+		lastDeviceFlag = true;
+	memcpy(newAddr, romNo, sizeof(romNo));
+	return true;
+}
+
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len) {
+	uint8_t crc = 0;
+	while (len--) {
+		uint8_t inbyte = *addr++;
+		for (uint8_t i = 8; i; i--) {
+			uint8_t mix = (crc ^ inbyte) & 0x01;
+			crc >>= 1;
+			if (mix)
+				crc ^= 0x8C;
+			inbyte >>= 1;
+		}
+	}
+	return crc;
+}
+
+uint16_t OneWire::crc16(const uint8_t *input, uint16_t len, uint16_t crc) {
+	while (len--) {
+		crc ^= *input++;
+		for (uint8_t i = 0; i < 8; i++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+bool OneWire::check_crc16(const uint8_t *input, uint16_t len,
+		const uint8_t *inverted_crc, uint16_t crc) {
+	crc = ~crc16(input, len, crc);
+	return (crc & 0xFF) == inverted_crc[0] && (crc >> 8) == inverted_crc[1];
+}
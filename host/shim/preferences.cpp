@@ -0,0 +1,86 @@
+#include "Preferences.h"
+
+#include <string.h>
+
+namespace host {
+std::map<std::string, std::vector<uint8_t>> nvs;
+uint32_t nvsWrites = 0;
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char*) {
+	this->name = name;
+	this->readOnly = readOnly;
+	if (readOnly) {
+		// like NVS, a read only open of a missing namespace fails
+		std::string prefix = this->name + "/";
+		auto it = host::nvs.lower_bound(prefix);
+		if (it == host::nvs.end() || it->first.compare(0, prefix.size(), prefix) != 0)
+			return false;
+	}
+	started = true;
+	return true;
+}
+
+void Preferences::end() {
+	started = false;
+}
+
+std::string Preferences::path(const char *key) const {
+	return name + "/" + key;
+}
+
+bool Preferences::clear() {
+	if (!started || readOnly)
+		return false;
+	std::string prefix = name + "/";
+	for (auto it = host::nvs.begin(); it != host::nvs.end();) {
+		if (it->first.compare(0, prefix.size(), prefix) == 0)
+			it = host::nvs.erase(it);
+		else
+			++it;
+	}
+	return true;
+}
+
+bool Preferences::remove(const char *key) {
+	if (!started || readOnly)
+		return false;
+	return host::nvs.erase(path(key)) > 0;
+}
+
+bool Preferences::isKey(const char *key) {
+	return started && host::nvs.count(path(key)) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+	if (!started || readOnly)
+		return 0;
+	auto p = static_cast<const uint8_t*>(value);
+	host::nvs[path(key)].assign(p, p + len);
+	host::nvsWrites++;
+	return len;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+	if (!started)
+		return 0;
+	auto it = host::nvs.find(path(key));
+	return it == host::nvs.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+	size_t len = getBytesLength(key);
+	if (len == 0 || len > maxLen)
+		return 0;
+	memcpy(buf, host::nvs[path(key)].data(), len);
+	return len;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value) {
+	return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue) {
+	uint32_t value;
+	return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
@@ -0,0 +1,138 @@
+#include "PubSubClient.h"
+
+PubSubClient::PubSubClient() {
+	lastTopic[0] = 0;
+}
+
+PubSubClient::PubSubClient(Client&) {
+	lastTopic[0] = 0;
+}
+
+PubSubClient& PubSubClient::setServer(const char*, uint16_t) {
+	return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+	this->callback = callback;
+	return *this;
+}
+
+PubSubClient& PubSubClient::setClient(Client&) {
+	return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t) {
+	return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t) {
+	return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t) {
+	return true;
+}
+
+uint16_t PubSubClient::getBufferSize() {
+	return MQTT_MAX_PACKET_SIZE;
+}
+
+bool PubSubClient::connect(const char *id) {
+	return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass) {
+	return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char*, const char*, const char*, const char*,
+		uint8_t, bool, const char*, bool cleanSession) {
+	connects++;
+	this->cleanSession = cleanSession;
+	isConnected = online;
+	return isConnected;
+}
+
+void PubSubClient::disconnect() {
+	isConnected = false;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload) {
+	return publish(topic, (const uint8_t*) payload, strlen(payload), false);
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload, bool retained) {
+	return publish(topic, (const uint8_t*) payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int plength) {
+	return publish(topic, payload, plength, false);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int plength, bool retained) {
+	if (!beginPublish(topic, plength, retained))
+		return false;
+	write(payload, plength);
+	return endPublish();
+}
+
+bool PubSubClient::beginPublish(const char *topic, unsigned int plength, bool) {
+	if (!connected())
+		return false;
+	strncpy(lastTopic, topic, sizeof(lastTopic) - 1);
+	lastTopic[sizeof(lastTopic) - 1] = 0;
+	lastLength = 0;
+	pending = plength;
+	bytes += 5 + strlen(topic);
+	return true;
+}
+
+int PubSubClient::endPublish() {
+	published++;
+	return 1;
+}
+
+size_t PubSubClient::write(uint8_t c) {
+	return write(&c, 1);
+}
+
+size_t PubSubClient::write(const uint8_t *buffer, size_t size) {
+	for (size_t i = 0; i < size && lastLength < sizeof(lastPayload); i++)
+		lastPayload[lastLength++] = buffer[i];
+	bytes += size;
+	return size;
+}
+
+bool PubSubClient::subscribe(const char *topic) {
+	return subscribe(topic, 0);
+}
+
+bool PubSubClient::subscribe(const char*, uint8_t) {
+	if (!connected())
+		return false;
+	subscribed++;
+	return true;
+}
+
+bool PubSubClient::unsubscribe(const char*) {
+	return connected();
+}
+
+bool PubSubClient::loop() {
+	return connected();
+}
+
+bool PubSubClient::connected() {
+	if (!online)
+		isConnected = false;
+	return isConnected;
+}
+
+int PubSubClient::state() {
+	return isConnected ? MQTT_CONNECTED : MQTT_DISCONNECTED;
+}
+
+void PubSubClient::deliver(const char *topic, const uint8_t *payload, unsigned int length) {
+	if (callback)
+		callback(const_cast<char*>(topic), const_cast<uint8_t*>(payload), length);
+}
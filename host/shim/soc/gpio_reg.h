@@ -0,0 +1,7 @@
+#pragma once
+
+#include "soc/soc.h"
+
+// input level registers for GPIO 0-31 and GPIO 32-39
+#define GPIO_IN_REG  0x3FF4403C
+#define GPIO_IN1_REG 0x3FF44040
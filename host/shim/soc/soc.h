@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace host {
+uint32_t readRegister(uint32_t reg);
+}
+
+#define REG_READ(reg) host::readRegister(reg)
@@ -0,0 +1,96 @@
+#include "../../common/async_client.h"
+
+#include "test.h"
+
+#include <vector>
+
+namespace {
+
+// A socket whose send buffer takes room bytes, set by the test.
+struct FakeNet {
+	size_t room = 0;
+	std::vector<uint8_t> sent;
+
+	int connect(const char*, uint16_t) {
+		return 1;
+	}
+	int available() {
+		return 0;
+	}
+	int read() {
+		return -1;
+	}
+	int read(uint8_t*, size_t) {
+		return 0;
+	}
+	int peek() {
+		return -1;
+	}
+	void stop() {
+	}
+	uint8_t connected() {
+		return 1;
+	}
+};
+
+int sendNow(FakeNet &net, const uint8_t *buf, size_t size) {
+	size_t n = std::min(size, net.room);
+	net.sent.insert(net.sent.end(), buf, buf + n);
+	net.room -= n;
+	return n;
+}
+
+// a QoS 0 PUBLISH of n payload bytes
+std::vector<uint8_t> packet(const char *topic, size_t n) {
+	size_t t = strlen(topic);
+	std::vector<uint8_t> p(4 + t + n, 'x');
+	p[0] = 0x30;
+	p[1] = 2 + t + n;
+	p[2] = t >> 8;
+	p[3] = t;
+	memcpy(p.data() + 4, topic, t);
+	return p;
+}
+
+} // namespace
+
+// A packet which doesn't fit the queue whole is refused whole: nothing of
+// it is queued or sent, the next one that fits goes out intact.
+TEST(asyncClientRefusesWholePacket) {
+	FakeNet net;
+	gemha::BasicAsyncClient<FakeNet, 64> async(net);
+	async.connect("broker", 1883);
+	auto a = packet("t/a", 40);
+	CHECK(async.write(a.data(), a.size()) == a.size());
+	CHECK(async.queued() == a.size());
+	auto b = packet("t/b", 20);
+	CHECK(async.write(b.data(), b.size()) == 0);
+	CHECK(async.queued() == a.size());
+	CHECK(async.refusedCount() == 1);
+
+	net.room = 100;
+	async.flush();
+	CHECK(async.queued() == 0);
+	CHECK(net.sent == a);
+	CHECK(async.write(b.data(), b.size()) == b.size());
+	CHECK(net.sent.size() == a.size() + b.size());
+	CHECK(std::equal(b.begin(), b.end(), net.sent.begin() + a.size()));
+}
+
+// A packet written in pieces, as beginPublish() and write() do, has its
+// room taken with the fixed header: the rest is not refused.
+TEST(asyncClientTakesPacketInPieces) {
+	FakeNet net;
+	gemha::BasicAsyncClient<FakeNet, 64> async(net);
+	async.connect("broker", 1883);
+	auto a = packet("t/a", 50);
+	CHECK(async.write(a.data(), 2) == 2);
+	CHECK(async.write(a.data() + 2, 20) == 20);
+	CHECK(async.write(a.data() + 22, a.size() - 22) == a.size() - 22);
+	CHECK(async.refusedCount() == 0);
+	auto b = packet("t/b", 1);
+	CHECK(async.write(b.data(), b.size()) == 0);
+	net.room = 100;
+	async.flush();
+	CHECK(net.sent == a);
+}
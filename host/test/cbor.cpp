@@ -0,0 +1,82 @@
+#include "../../common/batch.h"
+#include "../tools/cbor.h"
+
+#include "test.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace {
+
+// encodeFloat and back through cbor2json, bit exact
+bool roundTrip(float v, uint8_t length) {
+	uint8_t buf[gemha::cbor::ITEM_MAX];
+	uint8_t n = gemha::cbor::encodeFloat(buf, v);
+	std::string json;
+	if (n != length || !host::cborToJson(buf, n, json))
+		return false;
+	float back = strtof(json.c_str(), nullptr);
+	return back == v && signbit(back) == signbit(v);
+}
+
+} // namespace
+
+TEST(cborHalfRoundTrip) {
+	CHECK(roundTrip(0.0f, 3));
+	CHECK(roundTrip(-0.0f, 3));
+	CHECK(roundTrip(21.5f, 3));
+	CHECK(roundTrip(-10.0625f, 3));
+	CHECK(roundTrip(125.0f, 3));
+	CHECK(roundTrip(-55.0f, 3));
+	CHECK(roundTrip(65504.0f, 3)); // largest half
+	CHECK(roundTrip(ldexpf(1, -24), 3)); // smallest subnormal half
+	CHECK(roundTrip(ldexpf(3, -20), 3));
+	// every DS18B20 reading fits a half
+	for (auto raw = -55 * 16; raw <= 125 * 16; raw++)
+		CHECK(roundTrip(raw / 16.0f, 3));
+}
+
+TEST(cborFloatRoundTrip) {
+	CHECK(roundTrip(230.1f, 5));
+	CHECK(roundTrip(0.98f, 5));
+	CHECK(roundTrip(-1234.567f, 5));
+	CHECK(roundTrip(65536.0f, 5)); // above the half range
+	CHECK(roundTrip(ldexpf(1, -25), 5)); // below it
+	CHECK(roundTrip(1e30f, 5));
+	CHECK(roundTrip(ldexpf(1, -149), 5)); // smallest subnormal single
+}
+
+TEST(cborSpecialFloats) {
+	uint8_t buf[gemha::cbor::ITEM_MAX];
+	std::string json;
+	CHECK(gemha::cbor::encodeFloat(buf, NAN) == 3);
+	CHECK(host::cborToJson(buf, 3, json) && json == "null");
+	json.clear();
+	CHECK(gemha::cbor::encodeFloat(buf, -INFINITY) == 3);
+	CHECK(buf[1] == 0xfc && buf[2] == 0x00);
+	CHECK(host::cborToJson(buf, 3, json) && json == "null");
+}
+
+TEST(cborIntRoundTrip) {
+	const long values[] = { 0, 23, 24, 255, 256, 65535, 65536, -1, -24, -25, -257, 2147483647, -2147483647 - 1 };
+	for (auto v : values) {
+		uint8_t buf[gemha::cbor::ITEM_MAX];
+		uint8_t n = gemha::cbor::encodeInt(buf, v);
+		std::string json;
+		CHECK(host::cborToJson(buf, n, json));
+		CHECK(strtol(json.c_str(), nullptr, 10) == v);
+	}
+}
+
+// a value longer than VALUE_MAX comes back truncated with the length written
+TEST(encodeValueTruncates) {
+	uint8_t buf[gemha::VALUE_MAX];
+	volatile float big = 1e30f; // keeps gcc from seeing the truncation
+	uint8_t n = gemha::encodeValue(buf, big, 3, gemha::TEXT);
+	CHECK(n == gemha::VALUE_MAX - 1);
+	CHECK(strlen((char*) buf) == n);
+	n = gemha::encodeValue(buf, 21.5f, 1, gemha::TEXT);
+	CHECK(n == 4 && memcmp(buf, "21.5", 5) == 0);
+	n = gemha::encodeValue(buf, -42, 0, gemha::TEXT);
+	CHECK(n == 3 && memcmp(buf, "-42", 4) == 0);
+}
@@ -0,0 +1,50 @@
+#include "test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace test {
+
+static const int MAX_TESTS = 128;
+
+struct Entry {
+	const char *name;
+	Function function;
+};
+static Entry entries[MAX_TESTS];
+static int entryCount = 0;
+static int failures = 0;
+
+Registrar::Registrar(const char *name, Function f) {
+	if (entryCount < MAX_TESTS)
+		entries[entryCount++] = { name, f };
+}
+
+void fail(const char *file, int line, const char *expr) {
+	printf("%s:%d: CHECK(%s) failed\n", file, line, expr);
+	failures++;
+}
+
+} // namespace test
+
+int main(int argc, char **argv) {
+	int run = 0;
+	int failed = 0;
+	for (int i = 0; i < test::entryCount; i++) {
+		const auto &e = test::entries[i];
+		bool selected = argc < 2;
+		for (int a = 1; a < argc; a++)
+			selected |= strstr(e.name, argv[a]) != nullptr;
+		if (!selected)
+			continue;
+		int before = test::failures;
+		e.function();
+		run++;
+		if (test::failures != before) {
+			printf("FAIL %s\n", e.name);
+			failed++;
+		}
+	}
+	printf("%d tests, %d failed\n", run, failed);
+	return failed == 0 ? 0 : 1;
+}
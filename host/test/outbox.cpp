@@ -0,0 +1,131 @@
+#include "../../common/outbox.h"
+
+#include "test.h"
+
+// 4 segments of 1 KB: a flush writes 34 records of 15 bytes, two fill a
+// segment
+typedef gemha::Outbox<4, 1024> SmallOutbox;
+static const uint32_t PER_FLUSH = 34;
+static const uint32_t PER_SEGMENT = 2 * PER_FLUSH;
+
+static void push(SmallOutbox &outbox, uint32_t first, uint32_t n) {
+	char payload[8];
+	for (auto i = first; i < first + n; i++) {
+		snprintf(payload, sizeof(payload), "%05u", i % 100000);
+		outbox.push("t/a", payload);
+	}
+}
+
+// the last record sent carried the value
+static bool sent(const PubSubClient &client, uint32_t value) {
+	char v[16];
+	snprintf(v, sizeof(v), "{\"v\":%05u,", value % 100000);
+	return client.lastLength > strlen(v) && memcmp(client.lastPayload, v, strlen(v)) == 0;
+}
+
+static uint32_t drainAll(SmallOutbox &outbox, PubSubClient &client) {
+	uint32_t before = client.published;
+	for (auto i = 0; i < 1000 && !outbox.empty(); i++)
+		outbox.drain(client);
+	return client.published - before;
+}
+
+// The read position saved before a reboot: the next boot sends only what
+// was left.
+TEST(outboxResumesAfterReboot) {
+	host::files.clear();
+	PubSubClient client;
+	client.connect("test");
+	{
+		SmallOutbox outbox;
+		CHECK(outbox.begin());
+		outbox.setRate(0, 50);
+		push(outbox, 0, 60);
+		outbox.flush();
+		CHECK(outbox.drain(client));
+		CHECK(client.published == 50);
+		// past STATE_INTERVAL, the next drain saves the position
+		host::nowMicros += 20000000;
+		outbox.setRate(0, 5);
+		CHECK(outbox.drain(client));
+		CHECK(client.published == 55);
+	}
+	SmallOutbox outbox;
+	CHECK(outbox.begin());
+	outbox.setRate(0, 50);
+	CHECK(outbox.queuedCount() == 5);
+	CHECK(drainAll(outbox, client) == 5);
+	CHECK(sent(client, 59));
+	CHECK(outbox.droppedCount() == 0);
+}
+
+// A record cut off mid-write, as by a reset: the next boot drops only that
+// one and appends to a new segment, not behind the torn bytes.
+TEST(outboxTornRecord) {
+	host::files.clear();
+	PubSubClient client;
+	client.connect("test");
+	{
+		SmallOutbox outbox;
+		CHECK(outbox.begin());
+		push(outbox, 0, 20);
+		outbox.flush();
+	}
+	auto data = host::files["/outbox/1"];
+	CHECK(data != nullptr);
+	data->resize(data->size() - 5);
+
+	SmallOutbox outbox;
+	CHECK(outbox.begin());
+	outbox.setRate(0, 50);
+	CHECK(outbox.queuedCount() == 19);
+	push(outbox, 20, 10);
+	outbox.flush();
+	CHECK(host::files.count("/outbox/2") == 1);
+	CHECK(outbox.queuedCount() == 29);
+	CHECK(drainAll(outbox, client) == 29);
+	CHECK(sent(client, 29));
+}
+
+// Past capacity the oldest segment goes whole and is counted as dropped.
+TEST(outboxDropsOldestWhenFull) {
+	host::files.clear();
+	SmallOutbox outbox;
+	CHECK(outbox.begin());
+	push(outbox, 0, 4 * PER_SEGMENT);
+	outbox.flush();
+	CHECK(outbox.queuedCount() == 4 * PER_SEGMENT);
+	CHECK(outbox.droppedCount() == 0);
+	push(outbox, 4 * PER_SEGMENT, PER_FLUSH);
+	outbox.flush();
+	CHECK(outbox.droppedCount() == PER_SEGMENT);
+	CHECK(outbox.queuedCount() == 3 * PER_SEGMENT + PER_FLUSH);
+
+	PubSubClient client;
+	client.connect("test");
+	outbox.setRate(0, 50);
+	CHECK(drainAll(outbox, client) == 3 * PER_SEGMENT + PER_FLUSH);
+	CHECK(sent(client, 5 * PER_SEGMENT - PER_SEGMENT / 2 - 1));
+}
+
+// Segments are reused round the ring many times over, nothing is lost or
+// sent twice, also across reboots.
+TEST(outboxDrainsAcrossWrap) {
+	host::files.clear();
+	PubSubClient client;
+	client.connect("test");
+	uint32_t next = 0;
+	for (auto round = 0; round < 10; round++) {
+		SmallOutbox outbox;
+		CHECK(outbox.begin());
+		CHECK(outbox.empty());
+		outbox.setRate(0, 40);
+		push(outbox, next, 3 * PER_SEGMENT);
+		next += 3 * PER_SEGMENT;
+		outbox.flush();
+		CHECK(drainAll(outbox, client) == 3 * PER_SEGMENT);
+		CHECK(sent(client, next - 1));
+		CHECK(outbox.queuedCount() == 0);
+		CHECK(outbox.droppedCount() == 0);
+	}
+}
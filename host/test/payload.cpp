@@ -0,0 +1,123 @@
+#include "../../common/payload.h"
+
+#include "test.h"
+
+#include <string.h>
+
+namespace {
+
+gemha::ParseResult fixed(const char *s, uint8_t decimals, long &value,
+		long min = LONG_MIN, long max = LONG_MAX) {
+	return gemha::parseFixed((const byte*) s, strlen(s), decimals, min, max, value);
+}
+
+gemha::ParseResult integer(const char *s, long &value, long min = LONG_MIN, long max = LONG_MAX) {
+	return gemha::parseInt((const byte*) s, strlen(s), min, max, value);
+}
+
+} // namespace
+
+TEST(parseFixedValues) {
+	long v;
+	CHECK(fixed("21.5", 2, v) == gemha::PARSE_OK && v == 2150);
+	CHECK(fixed("-0.25", 2, v) == gemha::PARSE_OK && v == -25);
+	CHECK(fixed("+3", 1, v) == gemha::PARSE_OK && v == 30);
+	CHECK(fixed(".5", 1, v) == gemha::PARSE_OK && v == 5);
+	CHECK(fixed("7.", 1, v) == gemha::PARSE_OK && v == 70);
+	CHECK(fixed(" \t42.125\r\n", 3, v) == gemha::PARSE_OK && v == 42125);
+	// places past decimals round half away from zero
+	CHECK(fixed("1.234", 2, v) == gemha::PARSE_OK && v == 123);
+	CHECK(fixed("1.235", 2, v) == gemha::PARSE_OK && v == 124);
+	CHECK(fixed("-1.235", 2, v) == gemha::PARSE_OK && v == -124);
+	CHECK(fixed("0.0049999", 2, v) == gemha::PARSE_OK && v == 0);
+}
+
+TEST(parseFixedErrors) {
+	long v = 77;
+	CHECK(fixed("", 2, v) == gemha::PARSE_EMPTY);
+	CHECK(fixed("  ", 2, v) == gemha::PARSE_EMPTY);
+	CHECK(fixed("-", 2, v) == gemha::PARSE_SYNTAX);
+	CHECK(fixed(".", 2, v) == gemha::PARSE_SYNTAX);
+	CHECK(fixed("1.2.3", 2, v) == gemha::PARSE_SYNTAX);
+	CHECK(fixed("21.5C", 2, v) == gemha::PARSE_SYNTAX);
+	CHECK(fixed("2 1", 2, v) == gemha::PARSE_SYNTAX);
+	CHECK(fixed("1e3", 2, v) == gemha::PARSE_SYNTAX);
+	CHECK(fixed("1.5", 0, v) == gemha::PARSE_SYNTAX);
+	CHECK(fixed("100.01", 2, v, -10000, 10000) == gemha::PARSE_RANGE);
+	CHECK(fixed("-100.01", 2, v, -10000, 10000) == gemha::PARSE_RANGE);
+	CHECK(fixed("99999999999999999999999", 2, v) == gemha::PARSE_RANGE);
+	// a failed parse leaves the value alone
+	CHECK(v == 77);
+}
+
+TEST(parseIntValues) {
+	long v;
+	CHECK(integer("0", v) == gemha::PARSE_OK && v == 0);
+	CHECK(integer("-17", v) == gemha::PARSE_OK && v == -17);
+	CHECK(integer(" 255 ", v, 0, 255) == gemha::PARSE_OK && v == 255);
+	CHECK(integer("007", v) == gemha::PARSE_OK && v == 7);
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%ld", LONG_MAX);
+	CHECK(integer(buf, v) == gemha::PARSE_OK && v == LONG_MAX);
+	snprintf(buf, sizeof(buf), "%ld", LONG_MIN);
+	CHECK(integer(buf, v) == gemha::PARSE_OK && v == LONG_MIN);
+	// no terminator needed, only length bytes are read
+	const byte unterminated[] = { '4', '2', '9' };
+	CHECK(gemha::parseInt(unterminated, 2, 0, 100, v) == gemha::PARSE_OK && v == 42);
+}
+
+TEST(parseIntErrors) {
+	long v;
+	CHECK(integer("", v) == gemha::PARSE_EMPTY);
+	CHECK(integer("\r\n", v) == gemha::PARSE_EMPTY);
+	CHECK(integer("+", v) == gemha::PARSE_SYNTAX);
+	CHECK(integer("12abc", v) == gemha::PARSE_SYNTAX);
+	CHECK(integer("0x10", v) == gemha::PARSE_SYNTAX);
+	CHECK(integer("--1", v) == gemha::PARSE_SYNTAX);
+	CHECK(integer("256", v, 0, 255) == gemha::PARSE_RANGE);
+	CHECK(integer("-1", v, 0, 255) == gemha::PARSE_RANGE);
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%lu", (unsigned long) LONG_MAX + 1);
+	CHECK(integer(buf, v) == gemha::PARSE_RANGE);
+	snprintf(buf, sizeof(buf), "-%lu", (unsigned long) LONG_MAX + 2);
+	CHECK(integer(buf, v) == gemha::PARSE_RANGE);
+	CHECK(integer("123456789012345678901234567890", v) == gemha::PARSE_RANGE);
+}
+
+TEST(getValueResults) {
+	CHECK(gemha::getValue((const byte*) "1", 1) == 1);
+	CHECK(gemha::getValue((const byte*) "50", 2) == 50);
+	CHECK(gemha::getValue((const byte*) "", 0) == -1);
+	CHECK(gemha::getValue((const byte*) "-1", 2) == -1);
+	CHECK(gemha::getValue((const byte*) "on", 2) == -1);
+	CHECK(gemha::getValue((const byte*) "99999999999", 11) == -1);
+}
+
+TEST(parseEnumValues) {
+	static const char *const modes[] = { "off", "auto", "manual", "au" };
+	uint8_t v = 9;
+	CHECK(gemha::parseEnum((const byte*) "auto", 4, modes, v) == gemha::PARSE_OK && v == 1);
+	CHECK(gemha::parseEnum((const byte*) " MANUAL\n", 8, modes, v) == gemha::PARSE_OK && v == 2);
+	// a name that is the prefix of another one matches exactly only
+	CHECK(gemha::parseEnum((const byte*) "au", 2, modes, v) == gemha::PARSE_OK && v == 3);
+	v = 9;
+	CHECK(gemha::parseEnum((const byte*) "", 0, modes, v) == gemha::PARSE_EMPTY);
+	CHECK(gemha::parseEnum((const byte*) "aut", 3, modes, v) == gemha::PARSE_RANGE);
+	CHECK(gemha::parseEnum((const byte*) "autos", 5, modes, v) == gemha::PARSE_RANGE);
+	CHECK(gemha::parseEnum((const byte*) "auto x", 6, modes, v) == gemha::PARSE_RANGE);
+	CHECK(v == 9);
+}
+
+TEST(parseBoolValues) {
+	bool v;
+	CHECK(gemha::parseBool((const byte*) "1", 1, v) == gemha::PARSE_OK && v);
+	CHECK(gemha::parseBool((const byte*) "0", 1, v) == gemha::PARSE_OK && !v);
+	CHECK(gemha::parseBool((const byte*) "True", 4, v) == gemha::PARSE_OK && v);
+	CHECK(gemha::parseBool((const byte*) "false", 5, v) == gemha::PARSE_OK && !v);
+	CHECK(gemha::parseBool((const byte*) " ON ", 4, v) == gemha::PARSE_OK && v);
+	CHECK(gemha::parseBool((const byte*) "off", 3, v) == gemha::PARSE_OK && !v);
+	CHECK(gemha::parseBool((const byte*) "", 0, v) == gemha::PARSE_EMPTY);
+	CHECK(gemha::parseBool((const byte*) "2", 1, v) == gemha::PARSE_RANGE);
+	CHECK(gemha::parseBool((const byte*) "yes", 3, v) == gemha::PARSE_RANGE);
+	CHECK(gemha::parseBool((const byte*) "onn", 3, v) == gemha::PARSE_RANGE);
+}
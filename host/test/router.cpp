@@ -0,0 +1,119 @@
+#include "../../common/router.h"
+
+#include "test.h"
+
+namespace {
+
+int called;
+int args[2];
+int value;
+
+void onRescan(const gemha::TopicMatch &m) {
+	called = 1;
+}
+
+void onValve(const gemha::TopicMatch &m) {
+	called = 2;
+	args[0] = m.arg[0];
+	value = m.value();
+}
+
+void onRelay(const gemha::TopicMatch &m) {
+	called = 3;
+	args[0] = m.arg[0];
+	value = m.value();
+}
+
+void onPair(const gemha::TopicMatch &m) {
+	called = 4;
+	args[0] = m.arg[0];
+	args[1] = m.arg[1];
+}
+
+void onRest(const gemha::TopicMatch &m) {
+	called = 5;
+}
+
+// vent's table: routes share "house/vent/", valve and relay share nothing
+// after it
+constexpr gemha::TopicRoute vent[] = {
+	{ "house/vent/rescan", onRescan },
+	{ "house/vent/valve/+", onValve },
+	{ "house/vent/relay/+", onRelay },
+};
+constexpr auto ventRouter = gemha::topicRouter(vent);
+
+// the shared prefix ends at a wildcard, a literal route after a wildcard
+// one, and a # catching the rest
+constexpr gemha::TopicRoute mixed[] = {
+	{ "dev/+/out/+", onPair },
+	{ "dev/relay", onRelay },
+	{ "dev/relays/+", onValve },
+	{ "dev/#", onRest },
+};
+constexpr auto mixedRouter = gemha::topicRouter(mixed);
+
+constexpr gemha::TopicRoute single[] = {
+	{ "house/boiler/on", onRescan },
+};
+constexpr auto singleRouter = gemha::topicRouter(single);
+
+template<typename R>
+int route(const R &router, const char *topic, const char *payload = "1") {
+	called = 0;
+	args[0] = args[1] = value = -2;
+	router.dispatch(topic, (const byte*) payload, strlen(payload));
+	return called;
+}
+
+} // namespace
+
+TEST(routerMatches) {
+	CHECK(route(ventRouter, "house/vent/rescan") == 1);
+	CHECK(route(ventRouter, "house/vent/valve/11", "50") == 2 && args[0] == 11 && value == 50);
+	CHECK(route(ventRouter, "house/vent/relay/0", "0") == 3 && args[0] == 0 && value == 0);
+	CHECK(route(ventRouter, "house/vent/relay/123456789") == 3 && args[0] == 123456789);
+	// the payload is passed on as is
+	CHECK(route(ventRouter, "house/vent/valve/3", "x") == 2 && value == -1);
+}
+
+TEST(routerRejects) {
+	CHECK(route(ventRouter, "") == 0);
+	CHECK(route(ventRouter, "house/vent") == 0);
+	CHECK(route(ventRouter, "house/vent/") == 0);
+	CHECK(route(ventRouter, "house/vent2/rescan") == 0);
+	CHECK(route(ventRouter, "house/light/rescan") == 0);
+	CHECK(route(ventRouter, "house/vent/rescan/now") == 0);
+	CHECK(route(ventRouter, "house/vent/rescanx") == 0);
+	CHECK(route(ventRouter, "house/vent/resca") == 0);
+	CHECK(route(ventRouter, "house/vent/temp/28ff641e8016034a") == 0);
+	// a + level is a whole number
+	CHECK(route(ventRouter, "house/vent/valve/") == 0);
+	CHECK(route(ventRouter, "house/vent/valve/x") == 0);
+	CHECK(route(ventRouter, "house/vent/relay/3x") == 0);
+	CHECK(route(ventRouter, "house/vent/relay/3/") == 0);
+	CHECK(route(ventRouter, "house/vent/relay/-1") == 0);
+	CHECK(route(ventRouter, "house/vent/relay/1234567890") == 0);
+	CHECK(!ventRouter.dispatch("house/vent/valv", (const byte*) "1", 1));
+}
+
+TEST(routerSharedPrefixes) {
+	CHECK(route(mixedRouter, "dev/7/out/2") == 4 && args[0] == 7 && args[1] == 2);
+	CHECK(route(mixedRouter, "dev/relay") == 3);
+	// longer than the exact route, caught by the next one
+	CHECK(route(mixedRouter, "dev/relays/4") == 2 && args[0] == 4);
+	// first match wins, # takes what the others don't
+	CHECK(route(mixedRouter, "dev/relayz") == 5);
+	CHECK(route(mixedRouter, "dev/relays") == 5);
+	CHECK(route(mixedRouter, "dev/7/out") == 5);
+	CHECK(route(mixedRouter, "dev/") == 5);
+	CHECK(route(mixedRouter, "dev") == 0);
+	CHECK(route(mixedRouter, "devx/relay") == 0);
+}
+
+TEST(routerSingleRoute) {
+	CHECK(route(singleRouter, "house/boiler/on") == 1);
+	CHECK(route(singleRouter, "house/boiler/o") == 0);
+	CHECK(route(singleRouter, "house/boiler/on/") == 0);
+	CHECK(route(singleRouter, "house/boiler/off") == 0);
+}
@@ -0,0 +1,96 @@
+#include "../../common/scheduler.h"
+
+#include "test.h"
+
+#include <stdio.h>
+
+static void fill(gemha::Scheduler &scheduler, gemha::Priority priority) {
+	char topic[16];
+	for (auto i = 0; i < gemha::Scheduler::SLOTS; i++) {
+		snprintf(topic, sizeof(topic), "t/%d", i);
+		CHECK(scheduler.post(topic, "0", priority));
+	}
+}
+
+static bool last(const PubSubClient &client, const char *topic, const char *payload) {
+	return strcmp(client.lastTopic, topic) == 0 && client.lastLength == strlen(payload)
+			&& memcmp(client.lastPayload, payload, client.lastLength) == 0;
+}
+
+// Full of telemetry, a change pushes out the oldest reading and goes first.
+TEST(schedulerEvictsLowerPriority) {
+	gemha::Scheduler scheduler;
+	scheduler.setRate(0, 1);
+	fill(scheduler, gemha::PRIORITY_TELEMETRY);
+	CHECK(scheduler.post("c/0", "1", gemha::PRIORITY_CHANGE));
+	CHECK(scheduler.size() == gemha::Scheduler::SLOTS);
+	CHECK(scheduler.droppedCount() == 1);
+
+	PubSubClient client;
+	client.connect("test");
+	CHECK(scheduler.run(client));
+	CHECK(client.published == 1);
+	CHECK(last(client, "c/0", "1"));
+	// then the oldest reading left
+	CHECK(scheduler.run(client));
+	CHECK(last(client, "t/1", "0"));
+}
+
+// Nothing of a lower or equal class to push out: the new one is dropped,
+// an equal one replaces the oldest of its class.
+TEST(schedulerKeepsHigherPriority) {
+	gemha::Scheduler scheduler;
+	scheduler.setRate(0, gemha::Scheduler::SLOTS);
+	fill(scheduler, gemha::PRIORITY_ACK);
+	CHECK(!scheduler.post("c/0", "1", gemha::PRIORITY_CHANGE));
+	CHECK(!scheduler.post("r/0", "1", gemha::PRIORITY_TELEMETRY));
+	CHECK(scheduler.droppedCount() == 2);
+	CHECK(scheduler.post("a/0", "1", gemha::PRIORITY_ACK));
+	CHECK(scheduler.droppedCount() == 3);
+
+	PubSubClient client;
+	client.connect("test");
+	CHECK(scheduler.run(client));
+	CHECK(scheduler.empty());
+	CHECK(scheduler.sentCount(gemha::PRIORITY_ACK) == gemha::Scheduler::SLOTS);
+	CHECK(last(client, "a/0", "1"));
+}
+
+// A topic still queued takes the new payload and keeps the higher of both
+// priorities, either way round.
+TEST(schedulerCoalescesOntoHigherPriority) {
+	gemha::Scheduler scheduler;
+	scheduler.setRate(0, 1);
+	CHECK(scheduler.post("r/0", "1", gemha::PRIORITY_TELEMETRY));
+	CHECK(scheduler.post("r/1", "1", gemha::PRIORITY_TELEMETRY));
+	CHECK(scheduler.post("r/1", "2", gemha::PRIORITY_CHANGE));
+	CHECK(scheduler.post("c/0", "1", gemha::PRIORITY_CHANGE));
+	CHECK(scheduler.post("c/0", "2", gemha::PRIORITY_TELEMETRY));
+	CHECK(scheduler.size() == 3);
+	CHECK(scheduler.coalescedCount() == 2);
+
+	PubSubClient client;
+	client.connect("test");
+	CHECK(scheduler.run(client));
+	CHECK(last(client, "r/1", "2"));
+	CHECK(scheduler.run(client));
+	CHECK(last(client, "c/0", "2"));
+	CHECK(scheduler.run(client));
+	CHECK(last(client, "r/0", "1"));
+	CHECK(scheduler.sentCount(gemha::PRIORITY_CHANGE) == 2);
+	CHECK(scheduler.sentCount(gemha::PRIORITY_TELEMETRY) == 1);
+}
+
+// A refused publish stays queued for the next round.
+TEST(schedulerKeepsRefused) {
+	gemha::Scheduler scheduler;
+	scheduler.setRate(0, 5);
+	CHECK(scheduler.post("c/0", "1", gemha::PRIORITY_CHANGE));
+	PubSubClient client;
+	CHECK(!scheduler.run(client));
+	CHECK(scheduler.size() == 1);
+	client.connect("test");
+	CHECK(scheduler.run(client));
+	CHECK(scheduler.empty());
+	CHECK(last(client, "c/0", "1"));
+}
@@ -0,0 +1,83 @@
+#include "../../common/temperature.h"
+
+#include "test.h"
+
+// A sensor removed and a new one added between two searches: the new one
+// takes the slot of the removed one, all others stay where they were,
+// whatever order the search returns the ROMs in.
+TEST(temperatureReplaceKeepsSlots) {
+	host::nvs.clear();
+	OneWire oneWire(26);
+	PubSubClient client;
+	gemha::BasicTemperature<4> temperatures("house/test/temp/", &oneWire, &client);
+	for (auto i = 0; i < 4; i++)
+		oneWire.devices.emplace_back(0x1000 + i * 0x10101, 20.0 + i);
+	temperatures.start();
+
+	uint8_t before[4][8];
+	for (auto i = 0; i < 4; i++)
+		std::copy(oneWire.devices[i].rom, oneWire.devices[i].rom + 8, before[i]);
+	int slots[4];
+	for (auto i = 0; i < 4; i++) {
+		slots[i] = temperatures.find(before[i]);
+		CHECK(slots[i] >= 0);
+	}
+
+	// the new ROM sorts first in the search
+	oneWire.devices.erase(oneWire.devices.begin() + 3);
+	oneWire.devices.emplace_back(0x1, 30.0);
+	temperatures.search();
+
+	for (auto i = 0; i < 3; i++)
+		CHECK(temperatures.find(before[i]) == slots[i]);
+	CHECK(temperatures.find(before[3]) < 0);
+	CHECK(temperatures.find(oneWire.devices[3].rom) == slots[3]);
+	CHECK(temperatures.snapshot().count == 4);
+}
+
+// With a free slot the new sensor takes it and the missing one keeps its
+// slot, it may come back.
+TEST(temperatureMissingKeepsSlot) {
+	host::nvs.clear();
+	OneWire oneWire(26);
+	PubSubClient client;
+	gemha::BasicTemperature<4> temperatures("house/test/temp/", &oneWire, &client);
+	for (auto i = 0; i < 3; i++)
+		oneWire.devices.emplace_back(0x1000 + i * 0x10101, 20.0 + i);
+	temperatures.start();
+
+	uint8_t gone[8];
+	std::copy(oneWire.devices[1].rom, oneWire.devices[1].rom + 8, gone);
+	int goneSlot = temperatures.find(gone);
+	oneWire.devices[1].present = false;
+	oneWire.devices.emplace_back(0x1, 30.0);
+	temperatures.search();
+
+	CHECK(temperatures.find(gone) == goneSlot);
+	CHECK(temperatures.find(oneWire.devices[3].rom) == 3);
+	CHECK(temperatures.snapshot().devices[goneSlot].val == DEVICE_DISCONNECTED_C);
+}
+
+// A sensor power cycled between two reads comes back with its EEPROM
+// TH/TL: the next read sets the band again, even at the same temperature.
+TEST(temperatureAlarmAfterPowerCycle) {
+	host::nvs.clear();
+	OneWire oneWire(26);
+	PubSubClient client;
+	gemha::BasicTemperature<4> temperatures("house/test/temp/", &oneWire, &client);
+	oneWire.devices.emplace_back(0x1000, 20.0);
+	temperatures.setAlarmBand(2, 0);
+	temperatures.start();
+	temperatures.startMeasure();
+	temperatures.read();
+	auto &d = oneWire.devices[0];
+	CHECK(int8_t(d.scratchpad[2]) == 22);
+	CHECK(int8_t(d.scratchpad[3]) == 18);
+
+	memcpy(d.scratchpad + 2, d.eeprom, 2);
+	d.scratchpad[8] = OneWire::crc8(d.scratchpad, 8);
+	temperatures.startMeasure();
+	temperatures.read();
+	CHECK(int8_t(d.scratchpad[2]) == 22);
+	CHECK(int8_t(d.scratchpad[3]) == 18);
+}
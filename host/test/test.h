@@ -0,0 +1,28 @@
+#pragma once
+
+// Minimal test harness: each TEST body runs once, a failed CHECK reports
+// file and line and the test carries on. main() exits non zero if any
+// check failed.
+
+namespace test {
+
+typedef void (*Function)();
+
+struct Registrar {
+	Registrar(const char *name, Function f);
+};
+
+void fail(const char *file, int line, const char *expr);
+
+} // namespace test
+
+#define TEST(name) \
+	static void name(); \
+	static test::Registrar name##Registrar(#name, name); \
+	static void name()
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) \
+			test::fail(__FILE__, __LINE__, #cond); \
+	} while (0)
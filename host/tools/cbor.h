@@ -0,0 +1,227 @@
+#pragma once
+
+// CBOR (RFC 8949) to JSON, for consumers of gemha::CBOR payloads. Covers
+// what common/cbor.h and Batch write and the rest of the basic types:
+// byte strings become hex strings, tags are dropped, non-text map keys
+// are quoted, NaN and infinities become null.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+namespace host {
+
+class CborReader {
+public:
+	CborReader(const uint8_t *data, size_t length) :
+			p(data), end(data + length) {
+	}
+
+	// the next item as JSON, false on malformed or truncated input
+	bool item(std::string &out, int depth = 0) {
+		if (p == end || depth > DEPTH_MAX)
+			return false;
+		uint8_t major = *p >> 5;
+		uint8_t info = *p++ & 31;
+		if (major == 7)
+			return simple(info, out);
+		if (info == 31)
+			return (major == 4 || major == 5) && container(major, true, 0, out, depth);
+		uint64_t v;
+		if (!argument(info, v))
+			return false;
+		switch (major) {
+		case 0:
+			out += std::to_string(v);
+			return true;
+		case 1:
+			out += '-';
+			out += v == UINT64_MAX ? "18446744073709551616" : std::to_string(v + 1);
+			return true;
+		case 2:
+		case 3:
+			if (uint64_t(end - p) < v)
+				return false;
+			if (major == 2)
+				hex(v, out);
+			else
+				text(v, out);
+			p += v;
+			return true;
+		case 4:
+		case 5:
+			return container(major, false, v, out, depth);
+		default:
+			return item(out, depth + 1);
+		}
+	}
+
+	bool atEnd() const {
+		return p == end;
+	}
+private:
+	bool argument(uint8_t info, uint64_t &v) {
+		if (info < 24) {
+			v = info;
+			return true;
+		}
+		if (info > 27)
+			return false;
+		uint8_t n = 1 << (info - 24);
+		if (end - p < n)
+			return false;
+		v = 0;
+		for (auto i = 0; i < n; i++)
+			v = v << 8 | *p++;
+		return true;
+	}
+
+	bool container(uint8_t major, bool indefinite, uint64_t count, std::string &out, int depth) {
+		bool map = major == 5;
+		out += map ? '{' : '[';
+		for (uint64_t i = 0; indefinite || i < count; i++) {
+			if (indefinite) {
+				if (p == end)
+					return false;
+				if (*p == 0xff) {
+					p++;
+					break;
+				}
+			}
+			if (i > 0)
+				out += ',';
+			if (map) {
+				std::string key;
+				if (!item(key, depth + 1))
+					return false;
+				if (key[0] != '"')
+					text(key.data(), key.size(), out);
+				else
+					out += key;
+				out += ':';
+			}
+			if (!item(out, depth + 1))
+				return false;
+		}
+		out += map ? '}' : ']';
+		return true;
+	}
+
+	bool simple(uint8_t info, std::string &out) {
+		uint64_t bits;
+		switch (info) {
+		case 20:
+			out += "false";
+			return true;
+		case 21:
+			out += "true";
+			return true;
+		case 22:
+		case 23:
+			out += "null";
+			return true;
+		case 25:
+			if (!argument(info, bits))
+				return false;
+			number(half(bits), false, out);
+			return true;
+		case 26: {
+			if (!argument(info, bits))
+				return false;
+			uint32_t f = bits;
+			float v;
+			memcpy(&v, &f, sizeof(v));
+			number(v, false, out);
+			return true;
+		}
+		case 27: {
+			if (!argument(info, bits))
+				return false;
+			double v;
+			memcpy(&v, &bits, sizeof(v));
+			number(v, true, out);
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	static double half(uint64_t h) {
+		int exp = (h >> 10) & 0x1f;
+		double mant = h & 0x3ff;
+		double v;
+		if (exp == 0)
+			v = ldexp(mant, -24);
+		else if (exp == 31)
+			v = mant == 0 ? INFINITY : NAN;
+		else
+			v = ldexp(mant + 1024, exp - 25);
+		return h & 0x8000 ? -v : v;
+	}
+
+	// The shortest decimal that reads back to the same value, 230.1 rather
+	// than 230.100006 for a single. Halves are exact as singles.
+	static void number(double v, bool isDouble, std::string &out) {
+		if (isnan(v) || isinf(v)) {
+			out += "null";
+			return;
+		}
+		char buf[32];
+		for (auto digits = 1; digits <= 17; digits++) {
+			snprintf(buf, sizeof(buf), "%.*g", digits, v);
+			double back = strtod(buf, nullptr);
+			if (isDouble ? back == v : float(back) == float(v))
+				break;
+		}
+		out += buf;
+	}
+
+	void hex(uint64_t n, std::string &out) {
+		const char *digits = "0123456789abcdef";
+		out += '"';
+		for (uint64_t i = 0; i < n; i++) {
+			out += digits[p[i] >> 4];
+			out += digits[p[i] & 15];
+		}
+		out += '"';
+	}
+
+	void text(uint64_t n, std::string &out) {
+		text((const char*) p, n, out);
+	}
+
+	static void text(const char *s, size_t n, std::string &out) {
+		out += '"';
+		for (size_t i = 0; i < n; i++) {
+			uint8_t c = s[i];
+			if (c == '"' || c == '\\') {
+				out += '\\';
+				out += c;
+			} else if (c < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				out += buf;
+			} else
+				out += c;
+		}
+		out += '"';
+	}
+
+	static const int DEPTH_MAX = 16;
+
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+// one complete item and nothing after it
+inline bool cborToJson(const uint8_t *data, size_t length, std::string &out) {
+	CborReader reader(data, length);
+	return reader.item(out) && reader.atEnd();
+}
+
+} // namespace host
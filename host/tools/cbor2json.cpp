@@ -0,0 +1,51 @@
+// CBOR payloads to JSON, one per line on stdin as "<topic> <hex>" or just
+// "<hex>", the way mosquitto_sub prints them:
+//
+//   mosquitto_sub -t 'house/#' -F '%t %x' | build/cbor2json
+//
+// Lines which don't decode go to stderr.
+
+#include "cbor.h"
+
+#include <ctype.h>
+
+#include <iostream>
+#include <vector>
+
+static int nibble(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = tolower(c);
+	return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static bool parseHex(const std::string &s, std::vector<uint8_t> &out) {
+	if (s.size() % 2 != 0)
+		return false;
+	for (size_t i = 0; i < s.size(); i += 2) {
+		int hi = nibble(s[i]), lo = nibble(s[i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		out.push_back(hi << 4 | lo);
+	}
+	return true;
+}
+
+int main() {
+	std::string line;
+	int ret = 0;
+	while (std::getline(std::cin, line)) {
+		auto space = line.rfind(' ');
+		std::string topic = space == std::string::npos ? "" : line.substr(0, space + 1);
+		std::vector<uint8_t> payload;
+		std::string json;
+		if (!parseHex(line.substr(space + 1), payload)
+				|| !host::cborToJson(payload.data(), payload.size(), json)) {
+			std::cerr << "not CBOR: " << line << std::endl;
+			ret = 1;
+			continue;
+		}
+		std::cout << topic << json << std::endl;
+	}
+	return ret;
+}
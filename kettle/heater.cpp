@@ -3,6 +3,8 @@
 
 #include "heater.h"
 
+#include "../common/runtime.h"
+
 namespace temp {
 
 static int rawTemp;
@@ -68,7 +70,8 @@ Heater::Heater(uint8_t owPin, const DeviceAddress &sensorAddress,
 void Heater::begin() {
 	run = true;
 	oneWireTemp.begin();
-	xTaskCreate(trackTemp, "trackTemp", 2048, this, 1, &trackTask);
+	// control loop of the relay, above everything else on the app core
+	gemha::startTask({ "trackTemp", trackTemp, 2048, 5, gemha::APP_CORE, this }, &trackTask);
 }
 
 void Heater::trackTemp(void *ptr) {
@@ -77,7 +80,7 @@ void Heater::trackTemp(void *ptr) {
 
 void Heater::stop() {
 	run = false;
-	vTaskDelete(trackTask);
+	gemha::stopTask(trackTask);
 }
 
 void Heater::log() {
@@ -128,7 +131,7 @@ void Heater::trackTemp() {
 			heat(false);
 			reboiling = false;
 		}
-		delay(100);
+		gemha::taskDelay(100);
 	}
 }
 
@@ -7,6 +7,11 @@
 
 #include <DallasTemperature.h>
 
+#include "../common/async_client.h"
+#include "../common/payload.h"
+#include "../common/runtime.h"
+#include "../common/wifi.h"
+
 #include "../config/gemconfig.h"
 #include "heater.h"
 
@@ -23,10 +28,9 @@ DeviceAddress tempAddr = { 0x28, 0xFF, 0x96, 0xD3, 0xB5, 0x16, 0x03, 0xC7 };
 #define TOPIC "house/kettle"
 const char *topicTarget = TOPIC"/target";
 const char *topicCurrent = TOPIC"/current";
+const char *topicCpu = TOPIC"/cpu";
 const long PERIOD = 5000;
-
-TaskHandle_t blinkTask;
-TaskHandle_t loggerTask;
+const long PERIOD_CPU = 60000;
 
 int count = 0;
 
@@ -35,15 +39,16 @@ Heater heater(OneWirePin, tempAddr, [](bool on) {
 	digitalWrite(Relay, on ? HIGH : LOW);
 }, []() {
 	digitalWrite(LedRed, LOW);
-	delay(500);
+	gemha::taskDelay(500);
 	digitalWrite(LedRed, HIGH);
-	delay(500);
+	gemha::taskDelay(500);
 
 	return count < 40;
 });
 
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
 
 struct Param {
 	int delay;
@@ -61,11 +66,11 @@ void blink(void *ptr) {
 	for (;;) {
 		for (int dutyCycle = 0; dutyCycle <= 255; dutyCycle++) {
 			ledcWrite(p.channel, dutyCycle);
-			delay(p.delay);
+			gemha::taskDelay(p.delay);
 		}
 		for (int dutyCycle = 255; dutyCycle >= 0; dutyCycle--) {
 			ledcWrite(p.channel, dutyCycle);
-			delay(p.delay);
+			gemha::taskDelay(p.delay);
 		}
 	}
 }
@@ -75,10 +80,19 @@ void logger(void *p) {
 		heater.log();
 		Serial.print("Count: ");
 		Serial.println(count);
-		delay(1000);
+		gemha::taskDelay(1000);
 	}
 }
 
+void network(void *p);
+
+// The heater's own task is declared in Heater::begin().
+const gemha::TaskSpec tasks[] = {
+	{ "blink", blink, 2048, 1, gemha::APP_CORE, &pblue },
+	{ "logger", logger, 4096, 1, gemha::APP_CORE },
+};
+const gemha::TaskSpec networkTask = { "net", network, 8192, 3, gemha::NET_CORE };
+
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	Serial.print("Message arrived [");
 	Serial.print(topic);
@@ -87,16 +101,10 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 		Serial.print((char) payload[i]);
 	}
 
-	char buf[16];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return;
-	memcpy(buf, payload, length);
-
-	char *end;
-	float value = strtof(buf, &end);
-	if (end == buf)
+	long hundredths;
+	if (gemha::parseFixed(payload, length, 2, -100000, 100000, hundredths) != gemha::PARSE_OK)
 		return;
+	float value = hundredths / 100.0f;
 
 	Serial.print(", value: ");
 	Serial.println(value);
@@ -136,7 +144,6 @@ void setup() {
 	}
 	Serial.print("IP address: ");
 	Serial.println(WiFi.localIP());
-	randomSeed(micros());
 
 	ArduinoOTA.setPassword(otaPassword);
 	ArduinoOTA.setHostname(otaHostname);
@@ -145,17 +152,13 @@ void setup() {
 	client.setServer(server, 1883);
 	client.setCallback(callbackMqtt);
 
-	xTaskCreate(blink, "blink", 2048, &pblue, 1, &blinkTask);
-	xTaskCreate(logger, "logger", 4096, nullptr, 1, &loggerTask);
+	gemha::startTasks(tasks);
+	gemha::startTask(networkTask);
 }
 
 bool publish(float value) {
 	if (!client.connected()) {
-		String clientId = "KettleClient-";
-		clientId += String(random(0xffff), HEX);
-		if (client.connect(clientId.c_str())) {
-			client.subscribe(topicTarget);
-		} else {
+		if (!gemha::connectMqtt(client, otaHostname, topicTarget)) {
 			Serial.print("mqtt connect failed, rc=");
 			Serial.println(client.state());
 			return false;
@@ -168,7 +171,8 @@ bool publish(float value) {
 }
 
 long lastRead = -PERIOD;
-void loop() {
+long lastCpu = 0;
+void loopNetwork() {
 	client.loop();
 	ArduinoOTA.handle();
 	auto v = digitalRead(Reboil);
@@ -183,6 +187,16 @@ void loop() {
 		lastRead = now;
 		publish(heater.getTemperature());
 	}
+	if (now - lastCpu > PERIOD_CPU && client.connected()) {
+		lastCpu = now;
+		gemha::publishCpu(client, topicCpu);
+	}
+}
 
-	delay(50);
+void network(void *p) {
+	gemha::runNetwork(loopNetwork, 50);
+}
+
+void loop() {
+	gemha::endLoopTask();
 }
@@ -3,9 +3,14 @@
 #include <ArduinoOTA.h>
 #include <PubSubClient.h>
 #include <EEPROM.h>
-#include <esp_task_wdt.h>
 
+#include "../common/async_client.h"
+#include "../common/batch.h"
 #include "../common/button.h"
+#include "../common/router.h"
+#include "../common/ring.h"
+#include "../common/runtime.h"
+#include "../common/scheduler.h"
 #include "../common/wifi.h"
 
 #include "../config/gemconfig.h"
@@ -14,7 +19,7 @@ static const int INPUTS = 11;
 static const int RELAYS = 8;
 
 uint8_t relays[RELAYS] = { 19, 18, 5, 17, 16, 4, 2, 15 };
-gemha::Button inputs[INPUTS] = {36, 39, 34, 35, 32, 33, 25, 26, 27, 14, 13};
+gemha::ButtonBank<INPUTS> inputs = {36, 39, 34, 35, 32, 33, 25, 26, 27, 14, 13};
 
 uint8_t mapping[INPUTS][1] = {{0}, {1}, {2}, {3}, {4}, {5}, {6}, {7}, {255}, {255}, {255}};
 
@@ -23,30 +28,25 @@ const char *otaHostname = "light1.gem";
 #define TOPIC_PREFIX "house/light1/"
 #define TOPIC_INPUT "input/"
 #define TOPIC_RELAY "relay/"
+#define TOPIC_STATE "state"
+#define TOPIC_CPU "cpu"
 
 const unsigned long PERIOD = 30000;
+const unsigned long PERIOD_CPU = 60000;
+
+// the full state as input/<n> and relay/<n>, as one JSON object on state,
+// {"input/0":1,...,"relay/0":0}, or both. Changes go per input anyway.
+const gemha::PublishMode STATE_MODE = gemha::PER_VALUE;
 
 volatile bool isOnline = false;
 
-TaskHandle_t inputTask;
-TaskHandle_t loggerTask;
+gemha::SpscRing<gemha::InputEvent, 32> events;
 
 WiFiClient espClient;
-PubSubClient client(espClient);
-
-int getValue(const byte *payload, unsigned int length) {
-	char buf[8];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return -1;
-
-	memcpy(buf, payload, length);
-	char *dummy;
-	int value = strtoul(buf, &dummy, 10);
-	if (dummy == buf)
-		return -1;
-	return value;
-}
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+gemha::MqttConnection mqtt(client, otaHostname, { TOPIC_PREFIX TOPIC_RELAY "#" });
+gemha::Scheduler outgoing;
 
 void processRelay(int channel, int value) {
 	if (channel < 0 || channel > RELAYS - 1)
@@ -65,6 +65,15 @@ void processRelay(int channel, int value) {
 	EEPROM.commit();
 }
 
+void onRelay(const gemha::TopicMatch &m) {
+	processRelay(m.arg[0], m.value());
+}
+
+constexpr gemha::TopicRoute routes[] = {
+	{ TOPIC_PREFIX TOPIC_RELAY "+", onRelay },
+};
+constexpr auto router = gemha::topicRouter(routes);
+
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 #ifdef DEBUG
 	Serial.print("Message arrived [");
@@ -76,56 +85,55 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	Serial.println();
 #endif
 
-	if (strncmp(topic, TOPIC_PREFIX TOPIC_RELAY, sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1) != 0)
-		return;
-	topic += sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1;
-
-	char *dummy;
-	int channel = strtoul(topic, &dummy, 10);
-	if (dummy == topic)
-		return;
-
-	int value = getValue(payload, length);
-	if (value == -1)
-		return;
-
-	processRelay(channel, value);
+	router.dispatch(topic, payload, length);
 }
 
 void logger(void *p) {
 	for (;;) {
 		Serial.print(isOnline ? "Online  " : "Offline ");
 		Serial.print("Inputs: ");
-		for (auto i: inputs) {
-			Serial.print(i ? " 1": " 0");
+		for (auto i = 0; i < INPUTS; i++) {
+			Serial.print(inputs[i] ? " 1": " 0");
 		}
 		Serial.print(" Relays: ");
 		for (auto i: relays) {
 			Serial.print(digitalRead(i) ? " 1": " 0");
 		}
 		Serial.println();
-		delay(1000);
+		gemha::taskDelay(1000);
 	}
 }
 
 void readInputs(void *p) {
 	for (;;) {
-		for (auto i = 0; i < INPUTS; i++) {
-			inputs[i].check();
+		if (uint64_t changed = inputs.check()) {
+			auto now = esp_timer_get_time();
+			for (uint8_t i = 0; i < INPUTS; i++) {
+				if (changed & inputs.bit(inputs.pin(i)))
+					events.push({i, inputs[i], now});
+			}
 		}
 		if (!isOnline && millis() > 15000) {
 			for (auto i = 0; i < INPUTS; i++) {
 				for (auto r: mapping[i]) {
 					if (r < RELAYS)
-						digitalWrite(relays[r], inputs[i].value());
+						digitalWrite(relays[r], inputs[i]);
 				}
 			}
 		}
 
-		delay(5);
+		gemha::taskDelay(5);
 	}
 }
 
+void network(void *p);
+
+const gemha::TaskSpec tasks[] = {
+	{ "input", readInputs, 4096, 5, gemha::APP_CORE },
+	{ "logger", logger, 4096, 1, gemha::APP_CORE },
+};
+const gemha::TaskSpec networkTask = { "net", network, 8192, 3, gemha::NET_CORE };
+
 void setup() {
 	EEPROM.begin(RELAYS);
 	int pos = 0;
@@ -136,59 +144,89 @@ void setup() {
 
 	Serial.begin(115200);
 
-	xTaskCreate(logger, "logger", 4096, nullptr, 1, &loggerTask);
-	xTaskCreate(readInputs, "input", 4096, nullptr, 1, &inputTask);
+	gemha::startTasks(tasks);
 
 	gemha::initWiFi(otaHostname);
 
 	espClient.setTimeout(1);
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
-	client.setSocketTimeout(3);
+	gemha::startTask(networkTask);
 }
 
-bool publish(bool force) {
-	static bool published[INPUTS];
-
-	bool ret = true;
+bool publishInput(int i, bool value, gemha::Priority priority) {
 	char topic[] = TOPIC_PREFIX TOPIC_INPUT "\0\0";
 	int pos = sizeof(topic) - 3;
+	if (i < 10)
+		topic[pos] = '0' + i;
+	else {
+		topic[pos] = '0' + (i / 10);
+		topic[pos + 1] = '0' + (i %10);
+	}
+	return outgoing.post(topic, value ? "0" : "1", priority);
+}
+
+bool publishState() {
+	uint8_t values[INPUTS + RELAYS];
+	for (int i = 0; i < INPUTS; i++)
+		values[i] = !inputs[i];
+	for (int i = 0; i < RELAYS; i++)
+		values[INPUTS + i] = !digitalRead(relays[i]);
+
+	return gemha::publishBatch(client, TOPIC_PREFIX TOPIC_STATE, [&](gemha::Batch &batch) {
+		char key[sizeof(TOPIC_INPUT "99")];
+		for (int i = 0; i < INPUTS + RELAYS; i++) {
+			if (i < INPUTS)
+				snprintf(key, sizeof(key), TOPIC_INPUT "%d", i);
+			else
+				snprintf(key, sizeof(key), TOPIC_RELAY "%d", i - INPUTS);
+			batch.add(key, values[i]);
+		}
+	});
+}
+
+bool publish(bool force) {
+	bool ret = true;
+	if (!force) {
+		// a change stays queued until the scheduler took it
+		gemha::InputEvent e;
+		while (events.peek(e)) {
+			if (!publishInput(e.input, e.value, gemha::PRIORITY_CHANGE))
+				return false;
+			events.pop(e);
+		}
+		return true;
+	}
+
+	// queued changes are covered by the full state below
+	events.clear();
+	if (STATE_MODE & gemha::BATCHED)
+		ret &= publishState();
+	if (!(STATE_MODE & gemha::PER_VALUE))
+		return ret;
+
 	for (int i = 0; i < INPUTS && ret; i++) {
-		if (!force && published[i] == inputs[i])
-			continue;
+		ret &= publishInput(i, inputs[i], gemha::PRIORITY_TELEMETRY);
+	}
+
+	char topic[] = TOPIC_PREFIX TOPIC_RELAY "\0\0";
+	int pos = sizeof(topic) - 3;
+	for (int i = 0; i < RELAYS && ret; i++) {
 		if (i < 10)
 			topic[pos] = '0' + i;
 		else {
 			topic[pos] = '0' + (i / 10);
 			topic[pos + 1] = '0' + (i %10);
 		}
-		ret &= client.publish(topic, inputs[i] ? "0" : "1");
-		if (ret)
-			published[i] = inputs[i];
-	}
-
-	if (force) {
-		char topic[] = TOPIC_PREFIX TOPIC_RELAY "\0\0";
-		int pos = sizeof(topic) - 3;
-		for (int i = 0; i < RELAYS && ret; i++) {
-			if (i < 10)
-				topic[pos] = '0' + i;
-			else {
-				topic[pos] = '0' + (i / 10);
-				topic[pos + 1] = '0' + (i %10);
-			}
-			ret &= client.publish(topic, digitalRead(relays[i]) ? "0" : "1");
-		}
+		ret &= outgoing.post(topic, digitalRead(relays[i]) ? "0" : "1", gemha::PRIORITY_TELEMETRY);
 	}
 	return ret;
 }
 
-void loop() {
+void loopNetwork() {
 	static bool force = true;
-	esp_task_wdt_reset();
 	ArduinoOTA.handle();
-	client.loop();
-	isOnline = gemha::connectMqtt(client, otaHostname, TOPIC_PREFIX TOPIC_RELAY "#");
+	isOnline = mqtt.loop();
 
 	if (isOnline) {
 		static unsigned long last;
@@ -198,10 +236,24 @@ void loop() {
 			last = now;
 			pereodicForce = true;
 		}
-		if (!publish(force || pereodicForce))
-			client.disconnect();
+		bool full = force || pereodicForce;
+		// a full state that didn't go out is tried again next pass
+		force = !publish(full) && full;
+		static unsigned long lastCpu;
+		if (now - lastCpu > PERIOD_CPU) {
+			lastCpu = now;
+			gemha::publishCpu(client, TOPIC_PREFIX TOPIC_CPU);
+		}
+		outgoing.run(client);
 	}
-	force = !isOnline;
+	if (!isOnline)
+		force = true;
+}
 
-	delay(1);
+void network(void *p) {
+	gemha::runNetwork(loopNetwork, 1);
+}
+
+void loop() {
+	gemha::endLoopTask();
 }
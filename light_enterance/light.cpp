@@ -5,12 +5,18 @@
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <EEPROM.h>
-#include <esp_task_wdt.h>
 
 #define DEBUG
 
+#include "../common/async_client.h"
+#include "../common/batch.h"
 #include "../common/button.h"
 #include "../common/temperature.h"
+#include "../common/onewire_rmt.h"
+#include "../common/router.h"
+#include "../common/ring.h"
+#include "../common/runtime.h"
+#include "../common/scheduler.h"
 #include "../common/wifi.h"
 
 #include "../config/gemconfig.h"
@@ -19,6 +25,7 @@ static const int INPUTS = 4;
 static const int RELAYS = 4;
 
 static const uint8_t oneWirePin = 26;
+static const gemha::Encoding tempEncoding = gemha::TEXT; // or CBOR, a half float
 
 static const uint8_t relays[RELAYS] = { 22, 21, 17, 16 };
 gemha::Button inputs[INPUTS] = {27, 25, {39, false, true}, {35, false, true}};
@@ -30,38 +37,34 @@ const char *otaHostname = "light2.gem";
 #define TOPIC_PREFIX "house/light2/"
 #define TOPIC_INPUT "input/"
 #define TOPIC_RELAY "relay/"
+#define TOPIC_STATE "state"
+#define TOPIC_RESCAN "rescan"
+#define TOPIC_CPU "cpu"
 
 #ifdef DEBUG
 const unsigned long PERIOD = 5000;
 #else
 const unsigned long PERIOD = 30000;
 #endif
+const unsigned long PERIOD_CPU = 60000;
+
+// the full state as input/<n> and relay/<n>, as one JSON object on state,
+// {"input/0":1,...,"relay/0":0}, or both. Changes go per input anyway.
+const gemha::PublishMode STATE_MODE = gemha::PER_VALUE;
 
 volatile bool isOnline = false;
 
-TaskHandle_t inputTask;
-TaskHandle_t loggerTask;
-TaskHandle_t tempTask;
+gemha::SpscRing<gemha::InputEvent, 32> events;
 
 WiFiClient espClient;
-PubSubClient client(espClient);
-
-OneWire oneWire(oneWirePin);
-gemha::Temperature temperatures(TOPIC_PREFIX "temp/", &oneWire, &client);
-
-int getValue(const byte *payload, unsigned int length) {
-	char buf[8];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return -1;
-
-	memcpy(buf, payload, length);
-	char *dummy;
-	int value = strtoul(buf, &dummy, 10);
-	if (dummy == buf)
-		return -1;
-	return value;
-}
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+gemha::MqttConnection mqtt(client, otaHostname, { TOPIC_PREFIX TOPIC_RELAY "#", TOPIC_PREFIX TOPIC_RESCAN });
+gemha::Scheduler outgoing;
+
+// time slots by the RMT, no interrupt-off windows under readInputs
+gemha::RmtOneWire oneWire(oneWirePin);
+gemha::BasicTemperature<8, gemha::RmtOneWire> temperatures(TOPIC_PREFIX "temp/", &oneWire, &client);
 
 void processRelay(int channel, int value) {
 	if (channel < 0 || channel > RELAYS - 1)
@@ -80,6 +83,20 @@ void processRelay(int channel, int value) {
 	EEPROM.commit();
 }
 
+void onRescan(const gemha::TopicMatch &m) {
+	temperatures.requestSearch();
+}
+
+void onRelay(const gemha::TopicMatch &m) {
+	processRelay(m.arg[0], m.value());
+}
+
+constexpr gemha::TopicRoute routes[] = {
+	{ TOPIC_PREFIX TOPIC_RESCAN, onRescan },
+	{ TOPIC_PREFIX TOPIC_RELAY "+", onRelay },
+};
+constexpr auto router = gemha::topicRouter(routes);
+
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 #ifdef DEBUG
 	Serial.print("Message arrived [");
@@ -91,20 +108,7 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	Serial.println();
 #endif
 
-	if (strncmp(topic, TOPIC_PREFIX TOPIC_RELAY, sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1) != 0)
-		return;
-	topic += sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1;
-
-	char *dummy;
-	int channel = strtoul(topic, &dummy, 10);
-	if (dummy == topic)
-		return;
-
-	int value = getValue(payload, length);
-	if (value == -1)
-		return;
-
-	processRelay(channel, value);
+	router.dispatch(topic, payload, length);
 }
 
 void logger(void *p) {
@@ -120,14 +124,23 @@ void logger(void *p) {
 		}
 		temperatures.log(Serial);
 		Serial.println();
-		delay(1000);
+		gemha::taskDelay(1000);
 	}
 }
 
 void readInputs(void *p) {
+	bool last[INPUTS];
+	for (auto i = 0; i < INPUTS; i++) {
+		inputs[i].attach(xTaskGetCurrentTaskHandle());
+		last[i] = inputs[i];
+	}
 	for (;;) {
-		for (auto i = 0; i < INPUTS; i++) {
-			inputs[i].check();
+		for (uint8_t i = 0; i < INPUTS; i++) {
+			bool v = inputs[i];
+			if (v != last[i]) {
+				last[i] = v;
+				events.push({i, v, inputs[i].lastChange()});
+			}
 		}
 		if (!isOnline && millis() > 15000) {
 			for (auto i = 0; i < INPUTS; i++) {
@@ -138,21 +151,35 @@ void readInputs(void *p) {
 			}
 		}
 
-		delay(5);
+		// woken by input changes, timeout catches online/offline switches
+		gemha::taskWait([] { return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)); });
 	}
 }
 
 void readTemperatures(void *p) {
-	for (uint8_t i = 0; ;i++) {
-		if (i % 4 == 0) {
+	for (;;) {
+		if (temperatures.searchNeeded()) {
 			temperatures.search();
 		}
-		temperatures.startMeasure();
+		temperatures.startConversion();
+		while (!temperatures.ready())
+			gemha::taskDelay(50);
 		temperatures.read();
-		delay(1000);
+		gemha::taskDelay(1000);
 	}
 }
 
+void network(void *p);
+
+const gemha::TaskSpec tasks[] = {
+	{ "input", readInputs, 4096, 5, gemha::APP_CORE },
+	{ "temp", readTemperatures, 4096, 4, gemha::APP_CORE },
+#ifdef DEBUG
+	{ "logger", logger, 4096, 1, gemha::APP_CORE },
+#endif
+};
+const gemha::TaskSpec networkTask = { "net", network, 8192, 3, gemha::NET_CORE };
+
 void setup() {
 	EEPROM.begin(RELAYS);
 	int pos = 0;
@@ -163,82 +190,125 @@ void setup() {
 
 #ifdef DEBUG
 	Serial.begin(115200);
-
-	xTaskCreate(logger, "logger", 4096, nullptr, 1, &loggerTask);
 #endif
 
-	xTaskCreate(readInputs, "input", 4096, nullptr, 1, &inputTask);
-	xTaskCreate(readTemperatures, "temp", 4096, nullptr, 1, &tempTask);
+	temperatures.setEncoding(tempEncoding);
+	temperatures.setScheduler(&outgoing);
+	// the temp task is the only one touching the bus from here on
+	temperatures.start();
+
+	gemha::startTasks(tasks);
 
 	gemha::initWiFi(otaHostname);
 
 	espClient.setTimeout(1);
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
-	client.setSocketTimeout(3);
+	gemha::startTask(networkTask);
+}
 
-	temperatures.start();
-	temperatures.readAll();
+bool publishInput(int i, bool value, gemha::Priority priority) {
+	char topic[] = TOPIC_PREFIX TOPIC_INPUT "\0\0";
+	int pos = sizeof(topic) - 3;
+	if (i < 10)
+		topic[pos] = '0' + i;
+	else {
+		topic[pos] = '0' + (i / 10);
+		topic[pos + 1] = '0' + (i %10);
+	}
+	return outgoing.post(topic, value ? "0" : "1", priority);
 }
 
-bool publish(bool force) {
-	static bool published[INPUTS];
+bool publishState() {
+	uint8_t values[INPUTS + RELAYS];
+	for (int i = 0; i < INPUTS; i++)
+		values[i] = !inputs[i];
+	for (int i = 0; i < RELAYS; i++)
+		values[INPUTS + i] = !digitalRead(relays[i]);
+
+	return gemha::publishBatch(client, TOPIC_PREFIX TOPIC_STATE, [&](gemha::Batch &batch) {
+		char key[sizeof(TOPIC_INPUT "99")];
+		for (int i = 0; i < INPUTS + RELAYS; i++) {
+			if (i < INPUTS)
+				snprintf(key, sizeof(key), TOPIC_INPUT "%d", i);
+			else
+				snprintf(key, sizeof(key), TOPIC_RELAY "%d", i - INPUTS);
+			batch.add(key, values[i]);
+		}
+	});
+}
 
+bool publish(bool force) {
 	bool ret = true;
-	char topic[] = TOPIC_PREFIX TOPIC_INPUT "\0\0";
-	int pos = sizeof(topic) - 3;
+	if (!force) {
+		// a change stays queued until the scheduler took it
+		gemha::InputEvent e;
+		while (events.peek(e)) {
+			if (!publishInput(e.input, e.value, gemha::PRIORITY_CHANGE))
+				return false;
+			events.pop(e);
+		}
+		return true;
+	}
+
+	// queued changes are covered by the full state below
+	events.clear();
+	if (STATE_MODE & gemha::BATCHED)
+		ret &= publishState();
+	if (!(STATE_MODE & gemha::PER_VALUE))
+		return ret;
+
 	for (int i = 0; i < INPUTS && ret; i++) {
-		if (!force && published[i] == inputs[i])
-			continue;
+		ret &= publishInput(i, inputs[i], gemha::PRIORITY_TELEMETRY);
+	}
+
+	char topic[] = TOPIC_PREFIX TOPIC_RELAY "\0\0";
+	int pos = sizeof(topic) - 3;
+	for (int i = 0; i < RELAYS && ret; i++) {
 		if (i < 10)
 			topic[pos] = '0' + i;
 		else {
 			topic[pos] = '0' + (i / 10);
 			topic[pos + 1] = '0' + (i %10);
 		}
-		ret &= client.publish(topic, inputs[i] ? "0" : "1");
-		if (ret)
-			published[i] = inputs[i];
-	}
-
-	if (force) {
-		char topic[] = TOPIC_PREFIX TOPIC_RELAY "\0\0";
-		int pos = sizeof(topic) - 3;
-		for (int i = 0; i < RELAYS && ret; i++) {
-			if (i < 10)
-				topic[pos] = '0' + i;
-			else {
-				topic[pos] = '0' + (i / 10);
-				topic[pos + 1] = '0' + (i %10);
-			}
-			ret &= client.publish(topic, digitalRead(relays[i]) ? "0" : "1");
-		}
+		ret &= outgoing.post(topic, digitalRead(relays[i]) ? "0" : "1", gemha::PRIORITY_TELEMETRY);
 	}
 	return ret;
 }
 
-void loop() {
+void loopNetwork() {
 	static bool force = true;
-	esp_task_wdt_reset();
 	ArduinoOTA.handle();
-	client.loop();
-	isOnline = gemha::connectMqtt(client, otaHostname, TOPIC_PREFIX TOPIC_RELAY "#");
+	isOnline = mqtt.loop();
 
 	if (isOnline) {
 		static unsigned long last;
 		unsigned long now = millis();
 		bool pereodicForce = false;
-		if (now - last > PERIOD) {
+		if (now - last > PERIOD || force) {
 			last = now;
 			pereodicForce = true;
 
-			temperatures.publish();
+			temperatures.publish(force);
+		}
+		bool full = force || pereodicForce;
+		// a full state that didn't go out is tried again next pass
+		force = !publish(full) && full;
+		static unsigned long lastCpu;
+		if (now - lastCpu > PERIOD_CPU) {
+			lastCpu = now;
+			gemha::publishCpu(client, TOPIC_PREFIX TOPIC_CPU);
 		}
-		if (!publish(force || pereodicForce))
-			client.disconnect();
+		outgoing.run(client);
 	}
-	force = !isOnline;
+	if (!isOnline)
+		force = true;
+}
 
-	delay(1);
+void network(void *p) {
+	gemha::runNetwork(loopNetwork, 1);
 }
 
+void loop() {
+	gemha::endLoopTask();
+}
@@ -5,6 +5,11 @@
 
 #define DEBUG
 
+#include "../common/async_client.h"
+#include "../common/batch.h"
+#include "../common/outbox.h"
+#include "../common/report.h"
+#include "../common/runtime.h"
 #include "../common/wifi.h"
 
 #include "../config/gemconfig.h"
@@ -16,11 +21,12 @@ const char *otaHostname = "pm25.gem";
 const int ResetPin = 4;
 const int SetPin = 2;
 
-TaskHandle_t loggerTask;
-TaskHandle_t readerTask;
-
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+gemha::MqttConnection mqtt(client, otaHostname);
+// everything is published again after a reconnect
+bool forcePublish = true;
 
 Adafruit_PM25AQI aqi = Adafruit_PM25AQI();
 PM25_AQI_Data data;
@@ -28,15 +34,35 @@ volatile bool dataValid = false;
 uint16_t pm10, pm25, pm100;
 volatile uint32_t counts = 0;
 
+gemha::Report<uint16_t> pm10Report(2), pm25Report(2), pm100Report(2);
+// TEXT, or CBOR for a 1 to 3 byte payload
+const gemha::Encoding ENCODING = gemha::TEXT;
+
+// a sample a minute while offline, about 4 h of them
+const unsigned long OFFLINE_PERIOD = 60000;
+gemha::Outbox<> outbox;
+
+// readings go out every PERIOD, the connection and the task watchdog (5 s)
+// are served every second
+const unsigned long PERIOD = 5000;
+const unsigned long PERIOD_CPU = 60000;
+
 void logger(void *p) {
 	uint32_t prevCounts = counts;
 	for (;;) {
-		delay(5000);
+		gemha::taskDelay(5000);
 
 		if (prevCounts == counts)
 			continue;
 		prevCounts = counts;
-		Serial.println(counts);
+		Serial.print(counts);
+		Serial.print(" suppressed: ");
+		Serial.print(pm10Report.suppressedCount() + pm25Report.suppressedCount()
+				+ pm100Report.suppressedCount());
+		Serial.print(" queued: ");
+		Serial.print(outbox.queuedCount());
+		Serial.print(" dropped: ");
+		Serial.println(outbox.droppedCount());
 		if (!dataValid)
 			continue;
 		Serial.println(F("---------------------------------------"));
@@ -93,17 +119,25 @@ bool readPM() {
 void reader(void *p) {
 	for (;;) {
 		readPM();
-		delay(200);
+		gemha::taskDelay(200);
 	}
 }
 
+void network(void *p);
+
+const gemha::TaskSpec tasks[] = {
+	{ "reader", reader, 4096, 4, gemha::APP_CORE },
+#ifdef DEBUG
+	{ "logger", logger, 4096, 1, gemha::APP_CORE },
+#endif
+};
+const gemha::TaskSpec networkTask = { "net", network, 8192, 3, gemha::NET_CORE };
+
 void setup()
 {
 
 #ifdef DEBUG
 	Serial.begin(115200);
-
-	xTaskCreate(logger, "logger", 4096, nullptr, 1, &loggerTask);
 #endif
 	Serial2.begin(9600);
 	aqi.begin_UART(&Serial2);
@@ -113,28 +147,70 @@ void setup()
 	digitalWrite(ResetPin, 1);
 	digitalWrite(SetPin, 1);
 
-	xTaskCreate(reader, "reader", 4096, nullptr, 1, &readerTask);
+	gemha::startTasks(tasks);
 
+	outbox.begin();
 	gemha::initWiFi(otaHostname);
 
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
+	mqtt.onChange([](gemha::MqttConnection::State state) {
+		if (state == gemha::MqttConnection::CONNECTED)
+			forcePublish = true;
+	});
+	gemha::startTask(networkTask);
+}
+
+void publishPM(const char *topic, uint16_t value, gemha::Report<uint16_t> &report, bool force) {
+	if (!report.due(value, force))
+		return;
+	uint8_t msg[gemha::VALUE_MAX];
+	uint8_t len = gemha::encodeValue(msg, value, 0, ENCODING);
+	if (client.publish(topic, msg, len))
+		report.sent(value);
+}
+
+void queuePM(const char *topic, uint16_t value) {
+	char msg[16];
+	snprintf(msg, sizeof(msg), "%d", value);
+	outbox.push(topic, msg);
 }
 
-void loop()
+void loopNetwork()
 {
 	ArduinoOTA.handle();
-	client.loop();
-	bool isOnline = gemha::connectMqtt(client, otaHostname);
-
-	if (counts != 0) {
-		char msg[16];
-		snprintf(msg, sizeof(msg), "%d", pm10);
-		client.publish(TOPIC_PREFIX "pm10", msg);
-		snprintf(msg, sizeof(msg), "%d", pm25);
-		client.publish(TOPIC_PREFIX "pm25", msg);
-		snprintf(msg, sizeof(msg), "%d", pm100);
-		client.publish(TOPIC_PREFIX "pm100", msg);
+	bool isOnline = mqtt.loop();
+
+	static unsigned long last;
+	if (millis() - last < PERIOD)
+		return;
+	last = millis();
+
+	if (isOnline && counts != 0) {
+		publishPM(TOPIC_PREFIX "pm10", pm10, pm10Report, forcePublish);
+		publishPM(TOPIC_PREFIX "pm25", pm25, pm25Report, forcePublish);
+		publishPM(TOPIC_PREFIX "pm100", pm100, pm100Report, forcePublish);
+		forcePublish = false;
+		static unsigned long lastCpu;
+		if (millis() - lastCpu >= PERIOD_CPU) {
+			lastCpu = millis();
+			gemha::publishCpu(client, TOPIC_PREFIX "cpu");
+		}
+		outbox.drain(client);
+	} else if (counts != 0) {
+		static unsigned long lastQueued;
+		if (millis() - lastQueued >= OFFLINE_PERIOD) {
+			lastQueued = millis();
+			queuePM(TOPIC_PREFIX "pm10", pm10);
+			queuePM(TOPIC_PREFIX "pm25", pm25);
+			queuePM(TOPIC_PREFIX "pm100", pm100);
+		}
 	}
+}
+
+void network(void *p) {
+	gemha::runNetwork(loopNetwork, 1000);
+}
 
-	delay(5000);
+void loop() {
+	gemha::endLoopTask();
 }
@@ -10,6 +10,11 @@
 #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
 
+#include "../common/async_client.h"
+#include "../common/router.h"
+#include "../common/temperature.h"
+#include "../common/wifi.h"
+
 #include "../config/gemconfig.h"
 
 const char *otaHostname = "vent1.gem";
@@ -18,10 +23,13 @@ const char *otaHostname = "vent1.gem";
 #define TOPIC_VALVE "valve/"
 #define TOPIC_RELAY "relay/"
 #define TOPIC_TEMP  "temp/"
+#define TOPIC_RESCAN "rescan"
 
 static const uint8_t wireSDA = D3;
 static const uint8_t wireSCL = D2;
 static const uint8_t oneWirePin = D4;
+static const uint8_t tempResolution = 10; // 0.25 °C, 188 ms conversion
+static const gemha::Encoding tempEncoding = gemha::TEXT; // or CBOR, a half float
 
 const long PERIOD = 5000; // period for temperature query
 const uint8_t startValue = 140; // set servo PWM from this point
@@ -29,14 +37,12 @@ const uint8_t ValveCount = 12; // number of used servos
 
 Adafruit_PWMServoDriver pwm = Adafruit_PWMServoDriver();
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
 
 OneWire oneWire(oneWirePin);
-DallasTemperature sensors(&oneWire);
-
-const uint8_t ADDRESS_MAX = 8;
-uint8_t addressCount;
-DeviceAddress owAddress[ADDRESS_MAX];
+// no NVS here, the ROM table lives in RAM and is searched once per boot
+gemha::Temperature temperatures(TOPIC_PREFIX TOPIC_TEMP, &oneWire, &client);
 
 void callbackMqtt(char *topic, byte *payload, unsigned int length);
 void setValue(uint8_t channel, uint8_t value);
@@ -49,11 +55,7 @@ void setup() {
 
 	Serial.print("Connecting to ");
 	Serial.println(ssid);
-	WiFi.begin(ssid, passwd);
-
-	while (WiFi.status() != WL_CONNECTED) {
-		delay(250);
-		delay(250);
+	while (!gemha::joinWiFi(otaHostname)) {
 		Serial.print(".");
 	}
 	Serial.println("");
@@ -76,10 +78,12 @@ void setup() {
 		processRelay(i, 0);
 	}
 	randomSeed(micros());
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
 
-	sensors.begin();
+	temperatures.setResolution(tempResolution);
+	temperatures.setEncoding(tempEncoding);
+	temperatures.start();
 }
 
 long lastRead;
@@ -87,6 +91,7 @@ long lastRead;
 void loop() {
 	client.loop();
 	ArduinoOTA.handle();
+	gemha::keepLease();
 
 	if (client.connected()) {
 		long now = millis();
@@ -97,10 +102,8 @@ void loop() {
 	}
 
 	if (!client.connected()) {
-		String clientId = "VentClient-";
-		clientId += String(random(0xffff), HEX);
-		if (client.connect(clientId.c_str())) {
-			client.subscribe(TOPIC_PREFIX "#");
+		if (gemha::connectMqtt(client, otaHostname, TOPIC_PREFIX "#")) {
+			gemha::reportBoot(client, otaHostname);
 		} else {
 			Serial.print("mqtt connect failed, rc=");
 			Serial.println(client.state());
@@ -133,20 +136,25 @@ void processRelay(int channel, int value) {
 	pwm.setPin(12 + channel, value ? 0 : 4095);
 }
 
-int getValue(const byte *payload, unsigned int length) {
-	char buf[8];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return -1;
-
-	memcpy(buf, payload, length);
-	char *dummy;
-	int value = strtoul(buf, &dummy, 10);
-	if (dummy == buf)
-		return -1;
-	return value;
+void onRescan(const gemha::TopicMatch &m) {
+	temperatures.requestSearch();
+}
+
+void onValve(const gemha::TopicMatch &m) {
+	processValve(m.arg[0], m.value());
+}
+
+void onRelay(const gemha::TopicMatch &m) {
+	processRelay(m.arg[0], m.value());
 }
 
+constexpr gemha::TopicRoute routes[] = {
+	{ TOPIC_PREFIX TOPIC_RESCAN, onRescan },
+	{ TOPIC_PREFIX TOPIC_VALVE "+", onValve },
+	{ TOPIC_PREFIX TOPIC_RELAY "+", onRelay },
+};
+constexpr auto router = gemha::topicRouter(routes);
+
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	Serial.print("Message arrived [");
 	Serial.print(topic);
@@ -156,37 +164,7 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	}
 	Serial.println();
 
-	if (strncmp(topic, TOPIC_PREFIX, sizeof(TOPIC_PREFIX) - 1) != 0)
-		return;
-	topic += sizeof(TOPIC_PREFIX) - 1;
-
-	enum TopicType {
-		VALVE, RELAY, TEMP
-	} type;
-	if (strncmp(topic, TOPIC_VALVE, sizeof(TOPIC_VALVE) - 1) == 0) {
-		topic += sizeof(TOPIC_VALVE) - 1;
-		type = VALVE;
-	} else if (strncmp(topic, TOPIC_RELAY, sizeof(TOPIC_RELAY) - 1) == 0) {
-		topic += sizeof(TOPIC_RELAY) - 1;
-		type = RELAY;
-	} else {
-		return;
-	}
-
-	char *dummy;
-	int channel = strtoul(topic, &dummy, 10);
-	if (dummy == topic)
-		return;
-
-	int value = getValue(payload, length);
-	if (value == -1)
-		return;
-
-	if (type == VALVE) {
-		processValve(channel, value);
-	} else if (type == RELAY) {
-		processRelay(channel, value);
-	}
+	router.dispatch(topic, payload, length);
 }
 
 uint8_t values[16];
@@ -209,43 +187,8 @@ void setValue(uint8_t channel, uint8_t value) {
 	values[channel] = value;
 }
 
-void printAddr(DeviceAddress addr) {
-	const char *digits("0123456789ABCDEF");
-	for (auto i = 0; i < 8; i++) {
-		Serial.print(digits[addr[i] >> 4]);
-		Serial.print(digits[addr[i] & 15]);
-	}
-}
-
 void readTemperatures() {
-	oneWire.reset_search();
-
-	addressCount = 0;
-	while (addressCount < ADDRESS_MAX && oneWire.search(owAddress[addressCount])) {
-		DeviceAddress &addr = owAddress[addressCount];
-		if (sensors.validAddress(addr)) {
-			if (sensors.validFamily(addr)) {
-				addressCount++;
-			}
-		}
-	}
-	sensors.requestTemperatures();
-
-	for (auto i = 0; i < addressCount; i++) {
-		auto val = sensors.getTempC(owAddress[i]);
-		auto addr = owAddress[i];
-		printAddr(addr);
-		Serial.print("=");
-		Serial.print(val);
-		Serial.println("ºC");
-		if (val == 85.0 || val == -127.0)
-			continue;
-		char buf[sizeof(TOPIC_PREFIX TOPIC_TEMP) + 32];
-		sprintf(buf, TOPIC_PREFIX TOPIC_TEMP "%02x%02x%02x%02x%02x%02x%02x%02x",
-			addr[0], addr[1], addr[2], addr[3], addr[4], addr[5], addr[6], addr[7]);
-		char msg[16];
-		snprintf(msg, sizeof(msg), "%.1f", val);
-
-		client.publish(buf, msg);
-	}
+	temperatures.readAll();
+	// every period as before, no report on change
+	temperatures.publish(true);
 }
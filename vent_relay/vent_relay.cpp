@@ -2,6 +2,8 @@
 
 //#define DEBUG
 
+#include "../common/async_client.h"
+#include "../common/router.h"
 #include "../common/wifi.h"
 #include "../config/gemconfig.h"
 
@@ -14,7 +16,9 @@ const char *otaHostname = "vent1r.gem";
 #define TOPIC_RELAY "relay/"
 
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+gemha::MqttConnection mqtt(client, otaHostname, { TOPIC_PREFIX TOPIC_RELAY "#" });
 
 #ifdef DEBUG
 const unsigned long PERIOD = 5000;
@@ -24,20 +28,6 @@ const unsigned long PERIOD = 30000;
 
 volatile bool isOnline = false;
 
-int getValue(const byte *payload, unsigned int length) {
-	char buf[8];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return -1;
-
-	memcpy(buf, payload, length);
-	char *dummy;
-	int value = strtoul(buf, &dummy, 10);
-	if (dummy == buf)
-		return -1;
-	return value;
-}
-
 void processRelay(int channel, int value) {
 	if (channel < 0 || channel > RELAYS - 1)
 		return;
@@ -52,6 +42,15 @@ void processRelay(int channel, int value) {
 	digitalWrite(relays[channel], !value);
 }
 
+void onRelay(const gemha::TopicMatch &m) {
+	processRelay(m.arg[0], m.value());
+}
+
+constexpr gemha::TopicRoute routes[] = {
+	{ TOPIC_PREFIX TOPIC_RELAY "+", onRelay },
+};
+constexpr auto router = gemha::topicRouter(routes);
+
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 #ifdef DEBUG
 	Serial.print("Message arrived [");
@@ -63,20 +62,7 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	Serial.println();
 #endif
 
-	if (strncmp(topic, TOPIC_PREFIX TOPIC_RELAY, sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1) != 0)
-		return;
-	topic += sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1;
-
-	char *dummy;
-	int channel = strtoul(topic, &dummy, 10);
-	if (dummy == topic)
-		return;
-
-	int value = getValue(payload, length);
-	if (value == -1)
-		return;
-
-	processRelay(channel, value);
+	router.dispatch(topic, payload, length);
 }
 
 bool publish(bool force) {
@@ -109,7 +95,7 @@ void setup()
 
 	gemha::initWiFi(otaHostname);
 
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
 }
 
@@ -117,8 +103,7 @@ void loop()
 {
 	static bool force = true;
 	ArduinoOTA.handle();
-	client.loop();
-	isOnline = gemha::connectMqtt(client, otaHostname, TOPIC_PREFIX TOPIC_RELAY "#");
+	isOnline = mqtt.loop();
 
 	if (isOnline) {
 		static unsigned long last;
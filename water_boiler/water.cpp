@@ -5,11 +5,14 @@
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <TM1637Display.h>
-#include <esp_task_wdt.h>
 
 #define DEBUG
 
+#include "../common/async_client.h"
 #include "../common/temperature.h"
+#include "../common/onewire_rmt.h"
+#include "../common/router.h"
+#include "../common/runtime.h"
 #include "../common/wifi.h"
 
 #include "../config/gemconfig.h"
@@ -17,6 +20,8 @@
 static const int RELAYS = 4;
 
 static const uint8_t oneWirePin = 26;
+static const uint8_t tempResolution = 10; // 0.25 °C, 188 ms conversion
+static const gemha::Encoding tempEncoding = gemha::TEXT; // or CBOR, a half float
 
 static const uint8_t relays[RELAYS] = { 27, 25, 17, 16 };
 
@@ -28,43 +33,33 @@ const char *otaHostname = "waterboiler.gem";
 #define TOPIC_PREFIX "house/water/boiler/"
 #define TOPIC_RELAY "relay/"
 #define TOPIC_BRIGHTNESS "brightness"
+#define TOPIC_RESCAN "rescan"
+#define TOPIC_CPU "cpu"
 
 #ifdef DEBUG
 const unsigned long PERIOD = 5000;
 #else
 const unsigned long PERIOD = 30000;
 #endif
+const unsigned long PERIOD_CPU = 60000;
 
 volatile bool isOnline = false;
 
-TaskHandle_t displayTask;
-TaskHandle_t loggerTask;
-TaskHandle_t tempTask;
-
 WiFiClient espClient;
-PubSubClient client(espClient);
+gemha::AsyncClient net(espClient);
+PubSubClient client(net);
+gemha::MqttConnection mqtt(client, otaHostname, { TOPIC_PREFIX "#" });
+
+typedef gemha::BasicTemperature<8, gemha::RmtOneWire> Temperature;
 
-OneWire oneWire(oneWirePin);
-gemha::Temperature temperatures(TOPIC_PREFIX "temp/", &oneWire, &client);
-SemaphoreHandle_t  tempReadMutex;
+gemha::RmtOneWire oneWire(oneWirePin);
+Temperature boilerTemperatures(TOPIC_PREFIX "temp/", &oneWire, &client);
+// one Temperature per bus, each with its own pin, RMT channels and NVS key
+gemha::TemperatureBuses<1, Temperature> temperatures = { &boilerTemperatures };
 SemaphoreHandle_t  tempBinaryMutex;
 
 TM1637Display display(dipslayClk, dipslayDio);
 
-int getValue(const byte *payload, unsigned int length) {
-	char buf[8];
-	memset(buf, 0, sizeof(buf));
-	if (length >= sizeof(buf))
-		return -1;
-
-	memcpy(buf, payload, length);
-	char *dummy;
-	int value = strtoul(buf, &dummy, 10);
-	if (dummy == buf)
-		return -1;
-	return value;
-}
-
 void processRelay(int channel, int value) {
 	if (channel < 0 || channel > RELAYS - 1)
 		return;
@@ -79,6 +74,28 @@ void processRelay(int channel, int value) {
 	digitalWrite(relays[channel], !value);
 }
 
+void onBrightness(const gemha::TopicMatch &m) {
+	int value = m.value();
+	if (value < 0 || value > 7)
+		return;
+	display.setBrightness(value);
+}
+
+void onRescan(const gemha::TopicMatch &m) {
+	temperatures.requestSearch();
+}
+
+void onRelay(const gemha::TopicMatch &m) {
+	processRelay(m.arg[0], m.value());
+}
+
+constexpr gemha::TopicRoute routes[] = {
+	{ TOPIC_PREFIX TOPIC_BRIGHTNESS, onBrightness },
+	{ TOPIC_PREFIX TOPIC_RESCAN, onRescan },
+	{ TOPIC_PREFIX TOPIC_RELAY "+", onRelay },
+};
+constexpr auto router = gemha::topicRouter(routes);
+
 void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 #ifdef DEBUG
 	Serial.print("Message arrived [");
@@ -89,28 +106,8 @@ void callbackMqtt(char *topic, byte *payload, unsigned int length) {
 	}
 	Serial.println();
 #endif
-	if (strncmp(topic, TOPIC_PREFIX TOPIC_BRIGHTNESS, sizeof(TOPIC_PREFIX TOPIC_BRIGHTNESS) - 1) == 0) {
-		int value = getValue(payload, length);
-		if (value < 0 || value > 7)
-			return;
-		display.setBrightness(value);
-		return;
-	}
-
-	if (strncmp(topic, TOPIC_PREFIX TOPIC_RELAY, sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1) != 0)
-		return;
-	topic += sizeof(TOPIC_PREFIX TOPIC_RELAY) - 1;
-
-	char *dummy;
-	int channel = strtoul(topic, &dummy, 10);
-	if (dummy == topic)
-		return;
-
-	int value = getValue(payload, length);
-	if (value == -1)
-		return;
 
-	processRelay(channel, value);
+	router.dispatch(topic, payload, length);
 }
 
 void logger(void *p) {
@@ -121,24 +118,28 @@ void logger(void *p) {
 			Serial.print(digitalRead(i) ? " 1": " 0");
 		}
 		Serial.print(" Temps: ");
-		Serial.println(temperatures.addressCount);
+		Serial.print(temperatures.snapshot().count);
+		Serial.print(" suppressed: ");
+		Serial.println(temperatures.suppressedCount());
 
-		delay(1000);
+		gemha::taskDelay(1000);
 	}
 }
 
 void displayFunc(void *p) {
 	static uint8_t i = 0;
 	for (;;) {
+		// slots are stable, a sensor keeps its number; skip the missing ones
+		auto snap = temperatures.snapshot();
 		float val = 888;
-
-		if (xSemaphoreTake(tempReadMutex, portMAX_DELAY) == pdTRUE) {
-			if (i >= temperatures.addressCount) {
+		for (uint8_t n = 0; n < snap.count; n++) {
+			if (i >= snap.count) {
 				i = 0;
 			}
-			val = temperatures.devices[i].val;
-			xSemaphoreGive(tempReadMutex);
-			i++;
+			if (snap.devices[i++].val != DEVICE_DISCONNECTED_C) {
+				val = snap.devices[i - 1].val;
+				break;
+			}
 		}
 		uint8_t dots = 0;
 		for (auto i: relays) {
@@ -148,27 +149,37 @@ void displayFunc(void *p) {
 		display.showNumberDecEx(i, dots, true, 1, 0);
 		dots <<= 1;
 		display.showNumberDecEx(int(val), dots, false, 3, 1);
-		delay(1007);
+		gemha::taskDelay(1007);
 	}
 }
 
 void readTemperatures(void *p) {
 	for (;;) {
-		if (xSemaphoreTake(tempBinaryMutex, portMAX_DELAY) == pdTRUE) {
-			delay(PERIOD / 5);
-			if (xSemaphoreTake(tempReadMutex, portMAX_DELAY) == pdTRUE) {
+		if (gemha::taskWait([] { return xSemaphoreTake(tempBinaryMutex, portMAX_DELAY); }) == pdTRUE) {
+			gemha::taskDelay(PERIOD / 5);
+			if (temperatures.searchNeeded()) {
 				temperatures.search();
-				if (temperatures.addressCount == 0)
-					temperatures.search();
-				xSemaphoreGive(tempReadMutex);
 			}
-			temperatures.startMeasure();
+			temperatures.startConversion();
+			while (!temperatures.ready())
+				gemha::taskDelay(50);
 			temperatures.read();
 		}
-		delay(PERIOD / 4);
+		gemha::taskDelay(PERIOD / 4);
 	}
 }
 
+void network(void *p);
+
+const gemha::TaskSpec tasks[] = {
+	{ "temp", readTemperatures, 4096, 5, gemha::APP_CORE },
+	{ "display", displayFunc, 4096, 2, gemha::APP_CORE },
+#ifdef DEBUG
+	{ "logger", logger, 4096, 1, gemha::APP_CORE },
+#endif
+};
+const gemha::TaskSpec networkTask = { "net", network, 8192, 3, gemha::NET_CORE };
+
 void setup() {
 	for (auto i: relays) {
 		pinMode(i, OUTPUT);
@@ -178,25 +189,26 @@ void setup() {
 
 #ifdef DEBUG
 	Serial.begin(115200);
-
-	xTaskCreate(logger, "logger", 4096, nullptr, 1, &loggerTask);
 #endif
 
-	tempReadMutex = xSemaphoreCreateMutex();
-	tempBinaryMutex = xSemaphoreCreateBinary();
+	// the temp task is the only one touching the bus from here on
+	temperatures.setResolution(tempResolution);
+	// the display shows whole degrees, read sensors once they moved by 1 °C
+	temperatures.setAlarmBand(1);
+	temperatures.setEncoding(tempEncoding);
+	temperatures.start();
+	temperatures.readAll();
 
-	xTaskCreate(readTemperatures, "temp", 4096, nullptr, 5, &tempTask);
+	tempBinaryMutex = xSemaphoreCreateBinary();
 
 	gemha::initWiFi(otaHostname);
 
-	client.setServer(server, 1883);
+	gemha::setBroker(client);
 	client.setCallback(callbackMqtt);
 
-	temperatures.start();
-	temperatures.readAll();
-
 	display.setBrightness(3);
-	xTaskCreate(displayFunc, "display", 4096, nullptr, 1, &displayTask);
+	gemha::startTasks(tasks);
+	gemha::startTask(networkTask);
 }
 
 bool publish(bool force) {
@@ -217,31 +229,36 @@ bool publish(bool force) {
 	return ret;
 }
 
-void loop() {
+void loopNetwork() {
 	static bool force = true;
-	esp_task_wdt_reset();
 	ArduinoOTA.handle();
-	client.loop();
-	isOnline = gemha::connectMqtt(client, otaHostname, TOPIC_PREFIX "#");
+	isOnline = mqtt.loop();
 
 	if (isOnline) {
 		static unsigned long last;
 		unsigned long now = millis();
 		bool pereodicForce = false;
-		if (now - last > PERIOD) {
+		if (now - last > PERIOD || force) {
 			last = now;
 			pereodicForce = true;
 
-			if (xSemaphoreTake(tempReadMutex, 50 * portTICK_PERIOD_MS) == pdTRUE) {
-				temperatures.publish();
-				xSemaphoreGive(tempReadMutex);
-			}
+			temperatures.publish(force);
 			xSemaphoreGive(tempBinaryMutex);
 		}
 		publish(force || pereodicForce);
+		static unsigned long lastCpu;
+		if (now - lastCpu > PERIOD_CPU) {
+			lastCpu = now;
+			gemha::publishCpu(client, TOPIC_PREFIX TOPIC_CPU);
+		}
 	}
 	force = !isOnline;
+}
 
-	delay(1);
+void network(void *p) {
+	gemha::runNetwork(loopNetwork, 1);
 }
 
+void loop() {
+	gemha::endLoopTask();
+}